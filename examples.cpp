@@ -7,11 +7,16 @@
 #include "pin.h"
 #include "uart.h"
 #include "dma.h"
+#include "memory_transfer.h"
 #include "i2c.h"
 #include "spi.h"
+#include "spi_bus.h"
 #include "io_extender.h"
 #include "mcp23017.h"
+#include "eeprom_24lc.h"
 #include "sst25lf020.h"
+#include "sst25lf020_cache.h"
+#include "record_store.h"
 
 // Namespaces
 using namespace System;
@@ -78,13 +83,17 @@ void test_uart0_dma (void) {
 	DMA::enable();
 	UART0::instance().initialize();
 
+	// Get DMA channels from the pool
+	DMA & rx_dma = *DMA::allocate(DMA::TransferType::peripheral_to_memory, DMA::Peripheral::uart0_rx, DMA::Peripheral::unused);
+	DMA & tx_dma = *DMA::allocate(DMA::TransferType::memory_to_peripheral, DMA::Peripheral::unused, DMA::Peripheral::uart0_tx);
+
 	// Receive
 	uint8_t rx_buffer[16];
-	UART0::instance().receive(rx_buffer, sizeof(rx_buffer), DMAChannel<DMA::ch_0>::instance());
+	UART0::instance().receive(rx_buffer, sizeof(rx_buffer), rx_dma);
 
 	// Transmit
 	uint8_t tx_buffer[] = "Hello World!\r\n";
-	UART0::instance().transmit(tx_buffer, sizeof(tx_buffer), DMAChannel<DMA::ch_1>::instance());
+	UART0::instance().transmit(tx_buffer, sizeof(tx_buffer), tx_dma);
 
 	while (true) {
 
@@ -92,14 +101,13 @@ void test_uart0_dma (void) {
 		while (UART0::instance().isTransmitting()) {}
 
 		// Data available?
-		uint32_t bytes_available = UART0::instance().bytesAvailable();
-		if (bytes_available != 0) {
-
-			// Echo
-			for (uint32_t i = 0; i < bytes_available; i++) {
-				tx_buffer[i] = UART0::instance().getChar();
-			}
-			UART0::instance().transmit(tx_buffer, bytes_available, DMAChannel<DMA::ch_1>::instance());
+		UART::Span first, second;
+		if (UART0::instance().peek(first, second) != 0) {
+
+			// Echo directly from the receive ring buffer (a wrapped second part is echoed in the next iteration)
+			UART0::instance().transmit(first.data, first.length, tx_dma);
+			while (UART0::instance().isTransmitting()) {}
+			UART0::instance().consume(first.length);
 		}
 
 		// Pause, so we can accumulate data in the receive ring buffer
@@ -116,24 +124,21 @@ void test_uart1 (void) {
 	uint8_t rx_buffer[16];
 	UART1::instance().receive(rx_buffer, sizeof(rx_buffer));
 
-	// Transmit
+	// Transmit through a queue, so there is no need to wait for previous transfers
+	uint8_t tx_queue[64];
+	UART1::instance().transmitQueue(tx_queue, sizeof(tx_queue));
 	uint8_t tx_buffer[] = "Hello World!\r\n";
 	UART1::instance().transmit(tx_buffer, sizeof(tx_buffer));
 
 	while (true) {
 
-		// Make sure not to overwrite the TX buffer while still transmitting
-		while (UART1::instance().isTransmitting()) {}
-
 		// Data available?
-		uint32_t bytes_available = UART1::instance().bytesAvailable();
-		if (bytes_available != 0) {
-
-			// Echo
-			for (uint32_t i = 0; i < bytes_available; i++) {
-				tx_buffer[i] = UART1::instance().getChar();
-			}
-			UART1::instance().transmit(tx_buffer, bytes_available);
+		UART::Span first, second;
+		if (UART1::instance().peek(first, second) != 0) {
+
+			// Echo as much as fits in the transmit queue
+			uint16_t count = UART1::instance().write(first.data, first.length);
+			UART1::instance().consume(count);
 		}
 
 		// Pause, so we can accumulate data in the receive ring buffer
@@ -141,6 +146,26 @@ void test_uart1 (void) {
 	}
 }
 
+/***************************************************
+* Memory transfers
+***************************************************/
+
+void test_memory_transfer (void) {
+	init();
+	DMA::enable();
+
+	// Fill and copy a block in the background
+	static uint32_t source[256];
+	static uint32_t destination[256];
+	MemoryTransfer transfer;
+	transfer.fill(source, 0x55, sizeof(source));
+	transfer.wait();
+	transfer.copy(destination, source, sizeof(source));
+
+	// The CPU is free to do other work here
+	transfer.wait();
+}
+
 /***************************************************
 * I2C
 ***************************************************/
@@ -179,28 +204,30 @@ void test_i2c0 (void) {
 	}
 }
 
-void test_i2c1 (void) {
+uint32_t test_i2c1 (void) {
 	init();
 
-	// EEPROM 24LC64 over I2C1 at 100 kHz
+	// EEPROM 24LC64 (8 KB, 32 byte pages) over I2C1 at 100 kHz
 	I2C1::instance().initialize(Clock::PeripheralClockSpeed::cpu_divide_by_2, I2C::Mode::standard, I2C1::PinSelection::p0_19_and_p0_20);
-	uint8_t slave_address = 0xA0;
+	EEPROM24LC eeprom(I2C1::instance(), 0xA0, 8192, 32);
 
-	// Write 4 bytes at address 0
-	while (I2C1::instance().isBusy()) {}
-	uint8_t tx_buffer[] = {0x00, 0x00, 0x31, 0x32, 0x33, 0x34};
-	I2C1::instance().startTransfer(slave_address, tx_buffer, 6, nullptr, 0);
+	// Write 40 bytes at address 20, which crosses two page boundaries
+	uint8_t tx_buffer[40];
+	for (uint32_t i = 0; i < sizeof(tx_buffer); i++) {
+		tx_buffer[i] = 0x30 + i;
+	}
+	eeprom.write(20, tx_buffer, sizeof(tx_buffer));
 
-	// Give it plenty time to finish programming
-	Time::delay(100);
+	// Wait until the last write cycle is done (ACK polling)
+	while (eeprom.isBusy()) {}
 
-	// Read back the 4 bytes from address 0
-	while (I2C1::instance().isBusy()) {}
-	uint8_t rx_buffer[] = {0, 0, 0, 0};
-	I2C1::instance().startTransfer(slave_address, tx_buffer, 2, rx_buffer, 4);
+	// Read back the 40 bytes from address 20
+	uint8_t rx_buffer[40];
+	eeprom.read(20, rx_buffer, sizeof(rx_buffer));
+	while (eeprom.isBusy()) {}
 
-	// Wait for the I2C transaction to finish
-	while (I2C1::instance().isBusy()) {}
+	// Number of bus recoveries, 0 on a healthy bus (the pages and polls are queued from the completion handler)
+	return I2C1::instance().getNumberOfRecoveries();
 }
 
 /***************************************************
@@ -211,7 +238,7 @@ uint16_t test_spi0 (void) {
 	init();
 
 	// Initialize SPI0 with correct settings for the FLASH memory
-	SPI0::instance().initialize(System::Clock::PeripheralClockSpeed::cpu_divide_by_1, 1000000, // FIXME: SST25LF020::getMaximumClockFrequency(),
+	SPI0::instance().initialize(System::Clock::PeripheralClockSpeed::cpu_divide_by_1, SST25LF020::getMaximumClockFrequency(),
 			8, SST25LF020::isCPHA(), SST25LF020::isCPOL(), SST25LF020::isLSBFirst());
 
 	// Instantiate the FLASH memory
@@ -223,6 +250,49 @@ uint16_t test_spi0 (void) {
 	return ID;
 }
 
+void test_ssp0_flash_read (void) {
+	init();
+
+	// FLASH memory on SSP0, reads are streamed by DMA
+	SSP0::instance().initialize(System::Clock::PeripheralClockSpeed::cpu_divide_by_1, SST25LF020::getMaximumClockFrequency(),
+			8, SST25LF020::isCPHA(), SST25LF020::isCPOL());
+	DMA::enable();
+	DMA & rx_dma = *DMA::allocate(DMA::TransferType::peripheral_to_memory, DMA::Peripheral::ssp0_rx, DMA::Peripheral::unused, true);
+	DMA & tx_dma = *DMA::allocate(DMA::TransferType::memory_to_peripheral, DMA::Peripheral::unused, DMA::Peripheral::ssp0_tx);
+	GPIOPin ss_pin(PIN(0, 16));
+	SST25LF020 externalFlash = SST25LF020(SSP0::instance(), ss_pin, tx_dma, rx_dma);
+
+	// Read 4 kB, the CPU is free in the meantime
+	static uint8_t buffer[4096];
+	externalFlash.read(0x1000, buffer, sizeof(buffer));
+	while (externalFlash.isBusy()) {}
+
+	// Small repeated lookups are served from a cache of 8 pages of 256 bytes
+	SST25LF020Cache<256, 8> cache(externalFlash);
+	uint32_t value;
+	for (uint32_t i = 0; i < 64; i++) {
+		cache.read(0x2000 + ((i * 52) & 0x3FF), (uint8_t *) &value, sizeof(value));
+	}
+
+	// Log sensor records to the last 16 sectors, the flash is written in the background
+	externalFlash.unprotect();
+	RecordStore store(externalFlash, 48, 16);
+	if (!store.mount()) {
+		store.format();
+	}
+	for (uint32_t sample = 0; sample < 1000; sample++) {
+		uint16_t value = sample;
+		while (!store.write(sample & 0x07, &value, sizeof(value))) {
+			store.process();
+		}
+		store.process();
+	}
+	uint16_t latest;
+	store.read(0x07, &latest, sizeof(latest));
+	rx_dma.release();
+	tx_dma.release();
+}
+
 void test_ssp1 (void) {
 	init();
 
@@ -233,6 +303,38 @@ void test_ssp1 (void) {
 	uint8_t tx_buffer[] = {0x00, 0x00, 0x31, 0x32, 0x33, 0x34};
 	SSP1::instance().transmit(tx_buffer, sizeof(tx_buffer));
 	while (SSP1::instance().isBusy()) {}
+
+	// Read 256 bytes using DMA (the RX channel gets the higher priority)
+	DMA::enable();
+	DMA & rx_dma = *DMA::allocate(DMA::TransferType::peripheral_to_memory, DMA::Peripheral::ssp1_rx, DMA::Peripheral::unused, true);
+	DMA & tx_dma = *DMA::allocate(DMA::TransferType::memory_to_peripheral, DMA::Peripheral::unused, DMA::Peripheral::ssp1_tx);
+	uint8_t rx_buffer[256];
+	SSP1::instance().receive(rx_buffer, sizeof(rx_buffer), tx_dma, rx_dma);
+	while (SSP1::instance().isBusy()) {}
+	rx_dma.release();
+	tx_dma.release();
+}
+
+void test_ssp1_bus (void) {
+	init();
+
+	// Several chips share SSP1, each with its own settings
+	SSP1::instance().initialize();
+	SPIBus bus(SSP1::instance());
+	GPIOPin flash_cs(PIN(0, 6));
+	GPIOPin display_cs(PIN(0, 7));
+	SPIDevice flash(flash_cs, SST25LF020::getMaximumClockFrequency(), 8, SST25LF020::isCPHA(), SST25LF020::isCPOL());
+	SPIDevice display(display_cs, 4000000, 16, true, true);
+
+	// Queue the flash ID read and a display update, both run back-to-back from the ISR
+	uint8_t command[] = {0x90, 0x00, 0x00, 0x00};
+	uint8_t id[2];
+	SPIBus::Transaction read_id(flash, command, sizeof(command), nullptr, id, sizeof(id));
+	uint16_t pixels[] = {0xF800, 0x07E0, 0x001F};
+	SPIBus::Transaction update(display, nullptr, 0, pixels, nullptr, 3);
+	bus.submit(read_id);
+	bus.submit(update);
+	while (!read_id.isDone() || !update.isDone()) {}
 }
 
 /***************************************************
@@ -267,6 +369,7 @@ int main(void) {
 	test_clock_time_pin();
 	test_uart0_dma();
 	test_uart1();
+	test_memory_transfer();
 	test_i2c0();
 	test_i2c1();
 	test_spi0();
@@ -1,6 +1,11 @@
 #pragma once
 
-extern void (*_handleInterruptPointerDMA[]) (void);
+// Definitions, segments of up to 4095 transfers per channel (a 16-bit length in two halves, for the half completed event)
+#ifndef DMA_MAXIMUM_NUMBER_OF_SEGMENTS
+	#define DMA_MAXIMUM_NUMBER_OF_SEGMENTS	18
+#endif
+
+extern void (*_handleInterruptPointerDMA[]) (bool terminal_count, bool error);
 
 namespace System {
 
@@ -76,18 +81,65 @@ namespace System {
 			int32 = 2
 		} TransferWidth;
 
+		typedef enum {
+			completed = 0,
+			half_completed = 1,
+			error = 2
+		} Event;
+
+		// Linked list item (LLI), loaded by the hardware when the previous transfer is done
+		// NOTE: must be word aligned, and must stay in RAM while the transfer is running
+		typedef struct {
+			volatile uint32_t source;
+			volatile uint32_t destination;
+			volatile uint32_t next;
+			volatile uint32_t control;
+		} Descriptor;
+
 	private:
 		uint8_t _channel;
 		volatile uint32_t _control;
 		volatile uint32_t _config;
+		Descriptor _segments[DMA_MAXIMUM_NUMBER_OF_SEGMENTS];
+		static_assert(DMA_MAXIMUM_NUMBER_OF_SEGMENTS >= 2 * ((0x8000 + 4094) / 4095), "DMA segments must cover a 16-bit length (the widest the drivers pass)");
+		uint32_t _first;
+		uint32_t _total;
+		volatile uint32_t _completed;
+		volatile uint32_t _errors;
+		uint16_t _request_lines;
+
+		// Event handler
+		void (*_handler) (DMA::Event event, void * context);
+		void * _handler_context;
+		bool _half_completed_event;
+		volatile bool _half_completed_next;
+		bool _circular;
+
+	private:
+		void _transfer (Descriptor & first, bool half_completed_next, bool circular);
+		bool _prepareSegments (uint32_t & number_of_segments, volatile void * source, volatile void * destination, uint32_t offset, uint32_t number_of_transfers, bool interrupt);
 
 	protected:
 		DMA (DMA::Channel channel);
-		void handle (void);
+		void handle (bool terminal_count, bool error);
 
 	public:
 		static void enable (void);
 		static void disable (void);
+		static bool isEnabled (void);
+
+		// Channel pool, lower channel numbers have a higher priority
+		static DMA & getChannel (DMA::Channel channel);
+		static DMA * allocate (bool high_priority = false);
+		static DMA * allocate (DMA::TransferType transfer_type,
+					DMA::Peripheral source_peripheral,
+					DMA::Peripheral destination_peripheral,
+					bool high_priority = false);
+		bool claim (DMA::TransferType transfer_type = DMA::TransferType::memory_to_memory,
+					DMA::Peripheral source_peripheral = DMA::Peripheral::unused,
+					DMA::Peripheral destination_peripheral = DMA::Peripheral::unused);
+		void release (void);
+
 		void configure (DMA::TransferType transfer_type,
 					DMA::Peripheral source_peripheral,
 					DMA::Peripheral destination_peripheral,
@@ -97,7 +149,20 @@ namespace System {
 					DMA::TransferWidth destination_transfer_width,
 					bool source_increment,
 					bool destination_increment);
-		void transfer (volatile void * source, volatile void * destination, uint32_t number_of_transfers, bool auto_re_enable = false);
+		bool transfer (volatile void * source, volatile void * destination, uint32_t number_of_transfers, bool auto_re_enable = false);
+		void abort (void);
+
+		// Descriptor chains for scatter-gather, circular and ping-pong transfers
+		void prepare (Descriptor & descriptor, volatile void * source, volatile void * destination, uint32_t number_of_transfers, bool interrupt = false);
+		static void link (Descriptor * descriptors, uint32_t number_of_descriptors, bool circular = false);
+		void transfer (Descriptor & first);
+		uint32_t getNumberOfCompletedDescriptors (void);
+
+		// Events (called from the DMA interrupt), the half completed event only applies to transfer()
+		void attachHandler (void (*handler)(DMA::Event event, void * context), void * context = nullptr, bool half_completed_event = false);
+		void detachHandler (void);
+		uint32_t getNumberOfErrors (void);
+
 		uint32_t getTotalNumberOfTransfers (void);
 		uint32_t getNumberOfTransfersLeft (void);
 		uint32_t numberTransferred (void);
@@ -115,8 +180,8 @@ namespace System {
 		}
 		DMAChannel (DMAChannel const&) = delete;
 		void operator= (DMA const&) = delete;
-		static void handleInterrupt (void) {
-			instance().handle();
+		static void handleInterrupt (bool terminal_count, bool error) {
+			instance().handle(terminal_count, error);
 		}
 	public:
 		static DMAChannel & instance (void) {
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "i2c.h"
+
+// Definitions
+#ifndef EEPROM_24LC_MAXIMUM_POLLS
+	#define EEPROM_24LC_MAXIMUM_POLLS	200
+#endif
+
+using namespace System;
+
+// Microchip 24LCxx serial EEPROM (24LC01 up to 24LC512)
+// Reads and writes run in the background, from the I2C completion handler: writes are split in page-aligned bursts,
+// and the end of every write cycle is detected by polling the slave address until it is acknowledged again.
+// The buffers must stay valid until the EEPROM is no longer busy.
+class EEPROM24LC {
+
+private:
+	enum class Operation {
+		none,
+		read,
+		write,
+		poll
+	};
+
+	I2C & _i2c;
+	uint8_t _slave_address;
+	uint32_t _size;
+	uint32_t _page_size;
+	uint32_t _address_length;		// 1 byte up to 2 KB (the block is part of the slave address), 2 bytes above
+
+	// Transaction of the operation in progress
+	I2C::Transaction _transaction;
+	I2C::Segment _segments[2];
+	uint8_t _header[2];
+
+	// Operation in progress
+	volatile Operation _operation;
+	volatile bool _successful;
+	uint32_t _address;
+	uint8_t * _buffer;
+	uint32_t _length;
+	uint32_t _part;
+	uint32_t _polls;
+
+private:
+	static void handleCompletion (void * context);
+	uint8_t _setAddress (uint32_t address);
+	bool _submit (uint32_t number_of_segments, uint8_t nack_retries = I2C::Transaction::default_nack_retries);
+	bool _readNext (void);
+	bool _writeNext (void);
+	bool _poll (void);
+	void _finish (bool successful);
+
+public:
+	EEPROM24LC (I2C & i2c, uint8_t slave_address, uint32_t size, uint32_t page_size);
+	EEPROM24LC (EEPROM24LC const&) = delete;
+	void operator= (EEPROM24LC const&) = delete;
+
+	uint32_t getSize (void);
+	uint32_t getPageSize (void);
+	bool read (uint32_t address, uint8_t * buffer, uint32_t length);
+	bool write (uint32_t address, const uint8_t * data, uint32_t length);
+	bool isBusy (void);
+	bool isSuccessful (void);
+};
@@ -4,6 +4,14 @@
 #include "pin.h"
 #include "clock.h"
 
+// Definitions
+#ifndef I2C_NACK_RETRIES
+	#define I2C_NACK_RETRIES			3
+#endif
+#ifndef I2C_ARBITRATION_RETRIES
+	#define I2C_ARBITRATION_RETRIES		3
+#endif
+
 namespace System {
 
 	/************************************
@@ -18,14 +26,91 @@ namespace System {
 			fast_mode_plus
 		} Mode;
 
+		enum class Status {
+			idle = 0,
+			queued = 1,
+			active = 2,
+			completed = 3,
+			address_not_acknowledged = 4,	// No slave with this address, or the slave is busy
+			data_not_acknowledged = 5,		// The slave refused a byte that was written
+			arbitration_lost = 6,			// Another master (or a glitch) took over the bus
+			bus_error = 7					// Illegal START/STOP, the bus has been recovered
+		};
+
+		// One part of a message, the segments of a message are separated by repeated STARTs
+		struct Segment {
+			enum {
+				write = 0,
+				read = (1 << 0),
+				no_start = (1 << 1)		// Continue the previous write without a repeated START (e.g. a header and the data from separate buffers)
+			};
+
+			uint8_t slave_address;
+			uint8_t flags;
+			uint8_t * buffer;
+			uint16_t length;			// A write can be empty (only the address is sent), a read cannot
+		};
+
+		// A message (a list of segments) that is executed as a whole, from START to STOP
+		// The transaction (and its segments and buffers) must stay valid until it is no longer queued or active
+		struct Transaction {
+			static constexpr uint8_t default_nack_retries = 0xFF;
+
+			Segment * segments;
+			uint32_t number_of_segments;
+			Segment built_in[2];		// Used when segments is nullptr
+			uint8_t nack_retries;		// Retries after a NACK (0 for a probe that expects one), or the limit of setRetries()
+			uint8_t retries;			// Number of times the message has been restarted
+			void (*handler) (void * context);
+			void * context;
+			volatile Status status;
+			Transaction * next;
+
+			Transaction (void);
+			Transaction (Segment * segments, uint32_t number_of_segments);
+			Transaction (uint8_t slave_address, uint8_t * tx_buffer, uint16_t tx_length, uint8_t * rx_buffer, uint16_t rx_length);
+			Segment * getSegments (void);
+			bool isDone (void);
+			bool isSuccessful (void);
+		};
+
 	private:
 		LPC_I2C_TypeDef * _lpc_i2c;
-		volatile bool busy;
-		uint8_t slave_address;
-		volatile uint8_t * tx_buffer;
-		volatile uint8_t tx_length;
-		volatile uint8_t * rx_buffer;
-		volatile uint8_t rx_length;
+		uint32_t _pin_sda;
+		GPIO::Function _function;
+		uint32_t _half_period;
+		volatile bool _handling;
+
+		// Retry limits and error counters
+		uint8_t _nack_retries;
+		uint8_t _arbitration_retries;
+		uint32_t _nacks;
+		uint32_t _arbitration_losses;
+		uint32_t _bus_errors;
+		uint32_t _retries;
+		uint32_t _recoveries;
+
+		// Transaction queue, the first one is active
+		Transaction * volatile _head;
+		Transaction * _tail;
+		Transaction _transfer;
+
+		// Active segment
+		Segment * _segment;
+		Segment * _segment_end;
+		uint8_t _slave_address;
+		uint8_t * _buffer;
+		uint16_t _length;
+
+	private:
+		void _load (Transaction & transaction);
+		void _loadSegment (Segment * segment);
+		bool _continueSegment (void);
+		uint32_t _nextSegment (void);
+		uint32_t _finish (Status status);
+		bool _isBusFree (void);
+		void _delay (void);
+		bool _recover (void);
 
 	protected:
 		I2C (uint32_t instance);
@@ -34,7 +119,18 @@ namespace System {
 
 	public:
 		bool isBusy (void);
-		bool startTransfer (uint8_t slave_address, uint8_t * tx_buffer, uint8_t tx_length, uint8_t * rx_buffer, uint8_t rx_length);
+		bool submit (Transaction & transaction);
+		bool startTransfer (uint8_t slave_address, uint8_t * tx_buffer, uint16_t tx_length, uint8_t * rx_buffer, uint16_t rx_length);
+		void setRetries (uint8_t nack_retries, uint8_t arbitration_retries);
+		bool recover (void);
+
+		// Error counters
+		uint32_t getNumberOfNacks (void);
+		uint32_t getNumberOfArbitrationLosses (void);
+		uint32_t getNumberOfBusErrors (void);
+		uint32_t getNumberOfRetries (void);
+		uint32_t getNumberOfRecoveries (void);
+		void resetStatistics (void);
 	};
 
 	/************************************
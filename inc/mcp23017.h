@@ -10,8 +10,16 @@ class MCP23017 : public I2CIOExtender {
 
 private:
 
-	// Communication buffer
-	uint8_t _tx_buffer[2];
+	// Register writes are queued, with a transaction and buffer per register
+	// A write while the previous one to the same register is on the bus is sent once that one is done
+	struct RegisterWrite {
+		I2C * i2c;
+		I2C::Transaction transaction;
+		uint8_t buffer[2];
+		uint8_t value;
+		volatile bool pending;
+	};
+	RegisterWrite _writes[6];
 
 	// Shadow registers
 	uint8_t _iodira;	// 0x00
@@ -21,6 +29,10 @@ private:
 	uint8_t _gpioa;		// 0x12
 	uint8_t _gpiob;		// 0x13
 
+private:
+	static void handleWrite (void * context);
+	void _writeRegister (uint32_t index, uint8_t value);
+
 public:
 
 	MCP23017 (I2C & i2c, uint8_t slave_address);
@@ -31,4 +43,5 @@ public:
 	void clear (uint32_t pin);
 	void write (uint32_t pin, Pin::Level level);
 	Pin::Level read (uint32_t pin);
+	bool read (uint32_t pin, Pin::Level & level);
 };
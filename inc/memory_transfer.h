@@ -0,0 +1,41 @@
+#pragma once
+
+#include "LPC17xx.h"
+#include "dma.h"
+
+// Definitions
+// NOTE: the default is not measured, it is a guess at where setting up a channel and taking its interrupt costs as much as memcpy()
+#ifndef MEMORY_TRANSFER_DMA_THRESHOLD
+	#define MEMORY_TRANSFER_DMA_THRESHOLD	128
+#endif
+
+namespace System {
+
+	/************************************
+	* MemoryTransfer					*
+	************************************/
+
+	// Asynchronous copy/fill using a DMA channel from the pool, this object is the completion handle
+	// Small transfers (below MEMORY_TRANSFER_DMA_THRESHOLD bytes), or when no channel is available, are done by the CPU
+	class MemoryTransfer {
+
+	private:
+		DMA * _dma;
+		volatile bool _busy;
+		uint32_t _value;
+
+	private:
+		static void handleEvent (DMA::Event event, void * context);
+		bool start (void * destination, const void * source, uint32_t length, bool source_increment);
+
+	public:
+		MemoryTransfer (void);
+		MemoryTransfer (MemoryTransfer const&) = delete;
+		void operator= (MemoryTransfer const&) = delete;
+
+		bool copy (void * destination, const void * source, uint32_t length);
+		bool fill (void * destination, uint8_t value, uint32_t length);
+		bool isBusy (void);
+		void wait (void);
+	};
+}
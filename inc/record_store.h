@@ -0,0 +1,127 @@
+#pragma once
+
+#include "sst25lf020.h"
+
+// Definitions
+#ifndef RECORD_STORE_MAXIMUM_KEYS
+	#define RECORD_STORE_MAXIMUM_KEYS			32
+#endif
+#ifndef RECORD_STORE_MAXIMUM_RECORD_SIZE
+	#define RECORD_STORE_MAXIMUM_RECORD_SIZE	32
+#endif
+#ifndef RECORD_STORE_BUFFER_SIZE
+	#define RECORD_STORE_BUFFER_SIZE			256
+#endif
+
+using namespace System;
+
+// Append-only record store on (a range of sectors of) the SST25LF020
+// Every write appends a record, only the latest record of a key is kept. The sectors are used as a circular log,
+// so they all wear evenly: the sector after the active one is cleaned (its live records are copied forward)
+// and erased in the background, while writes are buffered in RAM and programmed with AAI bursts.
+//
+// Sector layout: header | records (key, length, data, checksum) ... | summary (latest record per key)
+// The summary is written when a sector is full, so mounting only reads headers and summaries,
+// and scans the records of the active sector.
+// NOTE: when power is lost while records are relocated, and the relocation is torn, the remaining records no longer
+// fit in the active sector. The store is then mounted read-only (isWritable() is false) until it is formatted.
+class RecordStore {
+
+private:
+	struct Header {
+		uint32_t magic;
+		uint32_t sequence;		// Still erased for a prepared (erased) sector
+		uint32_t erase_count;
+		uint32_t check;			// ~erase_count, tells a complete header from a torn one
+	};
+
+	struct Summary {
+		uint16_t offsets[RECORD_STORE_MAXIMUM_KEYS];
+		uint8_t lengths[RECORD_STORE_MAXIMUM_KEYS];
+		uint32_t marker;
+	};
+
+	struct Buffer {
+		uint8_t data[RECORD_STORE_BUFFER_SIZE];
+		uint32_t address;
+		uint32_t length;
+	};
+
+	static constexpr uint32_t _maximum_sectors = 64;
+	static constexpr uint32_t _record_header_size = 2;		// Key and length, the checksum follows the data
+	static constexpr uint32_t _record_size = 3;				// Without the data
+	static constexpr uint32_t _records_start = sizeof(Header);
+	static constexpr uint32_t _records_end = 4096 - sizeof(Summary);
+
+	static_assert((RECORD_STORE_MAXIMUM_KEYS * (_record_size + RECORD_STORE_MAXIMUM_RECORD_SIZE)) <= (_records_end - _records_start),
+			"The live records of one sector must fit in another");
+	static_assert((_record_size + RECORD_STORE_MAXIMUM_RECORD_SIZE) <= RECORD_STORE_BUFFER_SIZE,
+			"A record must fit in the write buffer");
+	static_assert(RECORD_STORE_MAXIMUM_KEYS < 0xFF, "Key 0xFF marks erased memory");
+
+	SST25LF020 & _flash;
+	bool _mounted;
+	uint32_t _first_sector;
+	uint32_t _number_of_sectors;
+	uint32_t _erase_counts[_maximum_sectors];
+
+	// Index, the address of the latest record of every key
+	uint32_t _addresses[RECORD_STORE_MAXIMUM_KEYS];
+	uint8_t _lengths[RECORD_STORE_MAXIMUM_KEYS];
+
+	// Active sector
+	uint32_t _active;
+	uint32_t _sequence;
+	bool _active_closed;
+	bool _read_only;
+	uint32_t _write_address;
+	uint32_t _programmed_address;
+	Summary _summary;
+
+	// Pending flash operations, in order of execution
+	Buffer _buffers[2];
+	uint32_t _fill;
+	bool _programming;
+	bool _close_pending;
+	uint32_t _closing_sector;
+	Summary _closing_summary;
+	bool _open_pending;
+	uint32_t _open_sequence;
+
+	// Cleaning of the sector after the active one
+	uint32_t _spare;
+	bool _spare_ready;
+	bool _spare_erasing;
+	uint32_t _relocate_key;
+	uint32_t _relocate_end;
+	uint32_t _reserved;
+	Header _header;
+
+private:
+	uint32_t _getSectorAddress (uint32_t sector);
+	uint32_t _getSector (uint32_t address);
+	uint32_t _next (uint32_t sector);
+	bool _readFlash (uint32_t address, void * buffer, uint32_t length);
+	void _copy (uint32_t address, uint8_t * buffer, uint32_t length);
+	static uint8_t _checksum (uint8_t key, uint8_t length, const uint8_t * data);
+	bool _append (uint8_t key, const uint8_t * data, uint8_t length);
+	bool _switchSector (void);
+	void _startCleaning (void);
+	uint32_t _scan (uint32_t sector, bool & torn);
+	static bool _isErased (const void * data, uint32_t length);
+	void _resetSummary (Summary & summary);
+
+public:
+	RecordStore (SST25LF020 & flash, uint32_t first_sector, uint32_t number_of_sectors);
+	RecordStore (RecordStore const&) = delete;
+	void operator= (RecordStore const&) = delete;
+
+	bool mount (void);
+	bool format (void);
+	bool write (uint8_t key, const void * data, uint8_t length);
+	uint8_t read (uint8_t key, void * data, uint8_t size);
+	void process (void);
+	bool isIdle (void);
+	bool isWritable (void);
+	uint32_t getMaximumEraseCount (void);
+};
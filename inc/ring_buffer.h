@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstdint>
+#if defined(__arm__)
+	#include "LPC17xx.h"
+#else
+	#include <atomic>
+#endif
+
+namespace System {
+
+	/************************************
+	* RingBufferBase<> Implementation	*
+	************************************/
+
+	// Lock-free single-producer/single-consumer ring buffer on top of external storage
+	// The producer (e.g. an ISR) only writes _head, the consumer (e.g. the main loop) only writes _tail
+	// Both indices are free running, the size is a power of two so an index is mapped using a mask
+	template<typename T>
+	class RingBufferBase {
+
+	public:
+		struct Span {
+			T * data;
+			uint32_t length;
+		};
+
+	private:
+		T * _buffer;
+		uint32_t _mask;
+		volatile uint32_t _head;
+		volatile uint32_t _tail;
+
+	private:
+		static inline void _fence (void) {
+			// Make sure the data is in memory before the index update is visible (and vice versa)
+#if defined(__arm__)
+			__DMB();
+#else
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+		}
+
+	public:
+		RingBufferBase (void) : _buffer(nullptr), _mask(0), _head(0), _tail(0) {
+		}
+
+		RingBufferBase (T * buffer, uint32_t size) {
+			assign(buffer, size);
+		}
+
+		// Use the given storage, only the largest power of two that fits the size is used
+		// Without storage (nullptr or a size of 0) nothing can be pushed
+		void assign (T * buffer, uint32_t size) {
+			_buffer = (size == 0) ? nullptr : buffer;
+			_mask = (_buffer == nullptr) ? 0 : (((uint32_t) 1 << (31 - __builtin_clz(size))) - 1);
+			_head = 0;
+			_tail = 0;
+		}
+
+		T * data (void) {
+			return _buffer;
+		}
+
+		uint32_t size (void) const {
+			return (_buffer == nullptr) ? 0 : (_mask + 1);
+		}
+
+		uint32_t available (void) const {
+			return _head - _tail;
+		}
+
+		uint32_t free (void) const {
+			return size() - available();
+		}
+
+		bool isEmpty (void) const {
+			return (_head == _tail);
+		}
+
+		bool isFull (void) const {
+			return (free() == 0);
+		}
+
+		/************************************
+		* Producer							*
+		************************************/
+
+		bool push (const T & item) {
+			uint32_t head = _head;
+			if ((head - _tail) >= size()) {
+				return false;
+			}
+			_buffer[head & _mask] = item;
+			_fence();
+			_head = head + 1;
+			return true;
+		}
+
+		uint32_t push (const T * items, uint32_t length) {
+			uint32_t head = _head;
+			uint32_t count = size() - (head - _tail);
+			if (length < count) {
+				count = length;
+			}
+
+			// Copy in at most two contiguous parts
+			uint32_t index = head & _mask;
+			uint32_t first = _mask + 1 - index;
+			if (first > count) {
+				first = count;
+			}
+			for (uint32_t i = 0; i < first; i++) {
+				_buffer[index + i] = items[i];
+			}
+			for (uint32_t i = first; i < count; i++) {
+				_buffer[i - first] = items[i];
+			}
+			_fence();
+			_head = head + count;
+			return count;
+		}
+
+		// Publish items that were written directly into the storage
+		void commit (uint32_t count) {
+			if (_buffer == nullptr) {
+				return;
+			}
+			_fence();
+			_head = _head + count;
+		}
+
+		// Publish items up to a position in the storage (for producers that only report a position, like a circular DMA)
+		void commitTo (uint32_t position) {
+			commit((position - _head) & _mask);
+		}
+
+		/************************************
+		* Consumer							*
+		************************************/
+
+		bool pop (T & item) {
+			uint32_t tail = _tail;
+			if (_head == tail) {
+				return false;
+			}
+			_fence();
+			item = _buffer[tail & _mask];
+			_fence();
+			_tail = tail + 1;
+			return true;
+		}
+
+		uint32_t pop (T * items, uint32_t length) {
+			uint32_t tail = _tail;
+			uint32_t count = _head - tail;
+			if (length < count) {
+				count = length;
+			}
+			_fence();
+
+			// Copy out at most two contiguous parts
+			uint32_t index = tail & _mask;
+			uint32_t first = _mask + 1 - index;
+			if (first > count) {
+				first = count;
+			}
+			for (uint32_t i = 0; i < first; i++) {
+				items[i] = _buffer[index + i];
+			}
+			for (uint32_t i = first; i < count; i++) {
+				items[i] = _buffer[i - first];
+			}
+			_fence();
+			_tail = tail + count;
+			return count;
+		}
+
+		// Get the unread items without copying, as (at most) two contiguous parts of the storage
+		uint32_t peek (Span & first, Span & second) {
+			uint32_t tail = _tail;
+			uint32_t count = _head - tail;
+			_fence();
+
+			uint32_t index = tail & _mask;
+			uint32_t length = _mask + 1 - index;
+			if (length > count) {
+				length = count;
+			}
+			first.data = _buffer + index;
+			first.length = length;
+			second.data = _buffer;
+			second.length = count - length;
+			return count;
+		}
+
+		// Release items that were read directly from the storage
+		void consume (uint32_t count) {
+			_fence();
+			_tail = _tail + count;
+		}
+
+		void clear (void) {
+			_tail = _head;
+		}
+	};
+
+	/************************************
+	* RingBuffer<> Implementation		*
+	************************************/
+
+	// Ring buffer with its own storage, the size must be a power of two
+	template<typename T, uint32_t N>
+	class RingBuffer : public RingBufferBase<T> {
+
+		static_assert((N != 0) && ((N & (N - 1)) == 0), "RingBuffer size must be a power of two");
+
+	private:
+		T _storage[N];
+
+	public:
+		RingBuffer (void) : RingBufferBase<T>(_storage, N) {
+		}
+		RingBuffer (RingBuffer const&) = delete;
+		void operator= (RingBuffer const&) = delete;
+	};
+}
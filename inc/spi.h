@@ -2,6 +2,16 @@
 
 #include "LPC17xx.h"
 #include "clock.h"
+#include "dma.h"
+
+// Definitions, transfers up to this number of frames are polled by default (0 always uses interrupts)
+// From tests/spi_polling_model.cpp: polling pays off up to 5 frames at the default configuration (PCLK = CCLK / 4 at the
+// fastest SSP clock, 8-bit frames), any length with faster SSP clocks (CCLK / 2, or CCLK / 4 with 8-bit frames), and only
+// up to 2-3 frames with slower ones.
+// The model uses estimated cycle costs, not measured on hardware. With other SSP clocks, use setPollingThreshold().
+#ifndef SPI_POLLING_THRESHOLD
+	#define SPI_POLLING_THRESHOLD	5
+#endif
 
 namespace System {
 
@@ -10,48 +20,89 @@ namespace System {
 	************************************/
 	class SPI {
 
+	public:
+		enum class TransferMode {
+			automatic = 0,			// Polled up to the polling threshold, interrupt driven above
+			interrupt_driven = 1,
+			polled = 2				// Blocks until done, with the peripheral interrupt disabled
+		};
+
 	private:
 		volatile uint32_t * _data_register;
-		volatile bool _busy;
-		bool _byte;
-		void * _tx_buffer;
+		const volatile uint32_t * _status_register;
+		uint32_t _receive_flag;
+		IRQn_Type _interrupt;
+		uint8_t _fifo_depth;
+		uint16_t _polling_threshold;
+		const void * _tx_buffer;
 		void * _rx_buffer;
+		uint32_t _tx_step;
+		uint32_t _rx_step;
 		uint16_t _length;
+		uint16_t _tx_length;
+		void (SPI::*_next) (void);
+
+		// Transfer completion handler
+		void (*_handler) (void * context);
+		void * _handler_context;
 
 	private:
-		void _write (void);
-		void _read (void);
-		bool _transceive (void * tx_buffer, void * rx_buffer, uint16_t length, bool byte);
+		template<typename T> void _write (void);
+		template<typename T> void _read (void);
+		template<typename T> void _nextFrame (void);
+		template<typename T> void _fill (void);
+		template<typename T> bool _transceive (const T * tx_buffer, T * rx_buffer, uint16_t length, TransferMode transfer_mode);
+		void _poll (uint16_t length);
+
+	protected:
+		volatile bool _busy;
 
 	protected:
-		SPI (volatile uint32_t * data_register);
+		SPI (volatile uint32_t * data_register, const volatile uint32_t * status_register, uint32_t receive_flag, IRQn_Type interrupt, uint8_t fifo_depth);
 		void next (void);
+		void complete (void);
 
 	public:
 		bool isBusy (void);
+		void setPollingThreshold (uint16_t length);
+		uint16_t getPollingThreshold (void);
+
+		// Change the bus settings of an initialized peripheral (only between transfers)
+		virtual bool configure (uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first) = 0;
+
+		// The handler is called when a transfer is done (from the ISR for interrupt and DMA driven transfers)
+		void attachHandler (void (*handler)(void * context), void * context = nullptr);
+		void detachHandler (void);
+		void getHandler (void (*&handler)(void * context), void *& context);
 
 		// 8-bit implementations
-		bool transmit (uint8_t * tx_buffer, uint16_t length);
-		bool receive (uint8_t * rx_buffer, uint16_t length);
-		bool transceive (uint8_t * tx_buffer, uint8_t * rx_buffer, uint16_t length);
+		bool transmit (uint8_t * tx_buffer, uint16_t length, TransferMode transfer_mode = TransferMode::automatic);
+		bool receive (uint8_t * rx_buffer, uint16_t length, TransferMode transfer_mode = TransferMode::automatic);
+		bool transceive (uint8_t * tx_buffer, uint8_t * rx_buffer, uint16_t length, TransferMode transfer_mode = TransferMode::automatic);
 
 		// 16-bit implementations
-		bool transmit (uint16_t * tx_buffer, uint16_t length);
-		bool receive (uint16_t * rx_buffer, uint16_t length);
-		bool transceive (uint16_t * tx_buffer, uint16_t * rx_buffer, uint16_t length);
+		bool transmit (uint16_t * tx_buffer, uint16_t length, TransferMode transfer_mode = TransferMode::automatic);
+		bool receive (uint16_t * rx_buffer, uint16_t length, TransferMode transfer_mode = TransferMode::automatic);
+		bool transceive (uint16_t * tx_buffer, uint16_t * rx_buffer, uint16_t length, TransferMode transfer_mode = TransferMode::automatic);
 	};
 
 	// LegacySPI implements only minimal SPI functionality
 	class LegacySPI : public SPI {
 
+	private:
+		uint32_t _peripheral_frequency;
+
 	private:
 		static volatile uint32_t * getDataRegister (void);
 
 	protected:
 		LegacySPI (void);
-		void initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode);
+		uint32_t initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode);
 		uint32_t mode (uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first);
 		void handle (void);
+
+	public:
+		bool configure (uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first);
 	};
 
 	// SSP extends standard SPI functionality
@@ -59,19 +110,76 @@ namespace System {
 
 	private:
 		LPC_SSP_TypeDef * _lpc_ssp;
+		uint32_t _peripheral_frequency;
+		DMA::Peripheral _tx_peripheral;
+		DMA::Peripheral _rx_peripheral;
+		DMA * _tx_dma;
+		DMA * _rx_dma;
 
 	private:
-		static volatile uint32_t * getDataRegister (uint32_t instance);
+		static LPC_SSP_TypeDef * getRegisters (uint32_t instance);
+		static void handleDMAEvent (DMA::Event event, void * context);
+		static void handleTXDMAEvent (DMA::Event event, void * context);
+		void _finishDMA (bool error);
+		bool _transceive (void * tx_buffer, void * rx_buffer, uint32_t length, bool byte, DMA & tx_dma, DMA & rx_dma);
 
 	protected:
 		SSP (uint32_t instance);
-		void initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode);
+		uint32_t initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode);
 		uint32_t mode (uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low);
 		void handle (void);
 
 	public:
-		//TODO:void transceive (uint8_t * tx_buffer, uint16_t tx_length, uint8_t * rx_buffer, uint16_t rx_buffer_size, DMA & tx_dma, DMA & rx_dma);
-		//TODO:void transceive (uint16_t * tx_buffer, uint16_t tx_length, uint16_t * rx_buffer, uint16_t rx_buffer_size, DMA & tx_dma, DMA & rx_dma);
+		// The SSP clock is PCLK / (CPSR * (SCR + 1)), with an even CPSR of 2...254 and an SCR of 0...255
+		struct ClockConfiguration {
+			uint32_t prescaler;
+			uint32_t scr;
+			uint32_t frequency;
+		};
+
+		// Find the highest SSP clock at or below the requested one (or the lowest possible clock if it is below that)
+		// Usable at compile time, e.g. to static_assert the clock a device will actually get
+		static constexpr ClockConfiguration calculateClock (uint32_t peripheral_frequency, uint32_t spi_clock_frequency) {
+			ClockConfiguration best = {254, 255, peripheral_frequency / (254 * 256)};
+			if (spi_clock_frequency == 0) {
+				return best;
+			}
+			for (uint32_t prescaler = 2; prescaler <= 254; prescaler += 2) {
+
+				// The smallest SCR for this prescaler that does not exceed the requested clock
+				uint64_t step = (uint64_t) prescaler * spi_clock_frequency;
+				uint64_t scale = (peripheral_frequency + step - 1) / step;
+				if (scale == 0) {
+					scale = 1;
+				} else if (scale > 256) {
+					continue;
+				}
+				uint32_t frequency = peripheral_frequency / (prescaler * (uint32_t) scale);
+				if (frequency > best.frequency) {
+					best = {prescaler, (uint32_t) scale - 1, frequency};
+				}
+				if (frequency == spi_clock_frequency) {
+					break;
+				}
+			}
+			return best;
+		}
+
+		bool configure (uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first);
+
+		using SPI::transmit;
+		using SPI::receive;
+		using SPI::transceive;
+
+		// 8-bit DMA implementations (both DMA channels are always used, the RX channel should have the higher priority)
+		bool transmit (uint8_t * tx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma);
+		bool receive (uint8_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma);
+		bool transceive (uint8_t * tx_buffer, uint8_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma);
+
+		// 16-bit DMA implementations
+		bool transmit (uint16_t * tx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma);
+		bool receive (uint16_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma);
+		bool transceive (uint16_t * tx_buffer, uint16_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma);
 	};
 
 	/************************************
@@ -87,7 +195,7 @@ namespace System {
 
 	public:
 		static SPI0 & instance (void);
-		void initialize (System::Clock::PeripheralClockSpeed clock = System::Clock::PeripheralClockSpeed::cpu_divide_by_4,
+		uint32_t initialize (System::Clock::PeripheralClockSpeed clock = System::Clock::PeripheralClockSpeed::cpu_divide_by_4,
 						uint32_t spi_clock_frequency = 1000000, uint32_t bits = 8, bool clock_phase_2nd_edge = false, bool clock_polarity_active_low = false, bool lsb_first = false);
 	};
 
@@ -104,7 +212,7 @@ namespace System {
 
 	public:
 		static SSP0 & instance (void);
-		void initialize (System::Clock::PeripheralClockSpeed clock = System::Clock::PeripheralClockSpeed::cpu_divide_by_4,
+		uint32_t initialize (System::Clock::PeripheralClockSpeed clock = System::Clock::PeripheralClockSpeed::cpu_divide_by_4,
 						uint32_t spi_clock_frequency = 1000000, uint32_t bits = 8, bool clock_phase_2nd_edge = false, bool clock_polarity_active_low = false);
 	};
 
@@ -121,7 +229,7 @@ namespace System {
 
 	public:
 		static SSP1 & instance (void);
-		void initialize (System::Clock::PeripheralClockSpeed clock = System::Clock::PeripheralClockSpeed::cpu_divide_by_4,
+		uint32_t initialize (System::Clock::PeripheralClockSpeed clock = System::Clock::PeripheralClockSpeed::cpu_divide_by_4,
 						uint32_t spi_clock_frequency = 1000000, uint32_t bits = 8, bool clock_phase_2nd_edge = false, bool clock_polarity_active_low = false);
 	};
 }
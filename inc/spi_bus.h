@@ -0,0 +1,100 @@
+#pragma once
+
+#include "LPC17xx.h"
+#include "spi.h"
+#include "pin.h"
+
+namespace System {
+
+	/************************************
+	* SPIDevice							*
+	************************************/
+
+	// A chip on a (shared) SPI bus, with its own bus settings and chip select pin
+	class SPIDevice {
+
+	public:
+		struct Configuration {
+			uint32_t clock_frequency;
+			uint32_t bits;
+			bool clock_phase_2nd_edge;
+			bool clock_polarity_active_low;
+			bool lsb_first;
+
+			bool operator== (const Configuration & configuration) const;
+		};
+
+	private:
+		Pin & _pin_cs;
+		Configuration _configuration;
+
+	public:
+		SPIDevice (Pin & pin_cs, uint32_t clock_frequency, uint32_t bits = 8, bool clock_phase_2nd_edge = false, bool clock_polarity_active_low = false, bool lsb_first = false);
+		const Configuration & getConfiguration (void) const;
+		bool configure (SPI & spi) const;
+		void select (void);
+		void deselect (void);
+	};
+
+	/************************************
+	* SPIBus							*
+	************************************/
+
+	// Arbiter that queues transactions of several devices on one SPI peripheral, and runs them back-to-back from the ISR
+	// The bus settings are only reprogrammed when the next device needs different ones
+	class SPIBus {
+
+	public:
+		enum class Status {
+			idle = 0,
+			queued = 1,
+			active = 2,
+			completed = 3,
+			failed = 4				// The device settings are not supported by the peripheral
+		};
+
+		// The chip is selected during the whole transaction: the command is sent first (the received frames are discarded),
+		// then the data is transceived (either buffer can be nullptr). Buffers hold uint16_t frames for devices above 8 bits.
+		// The transaction (and its buffers) must stay valid until it is no longer queued or active.
+		struct Transaction {
+			SPIDevice * device;
+			void * command;
+			uint16_t command_length;
+			void * tx_buffer;
+			void * rx_buffer;
+			uint16_t length;
+			void (*handler) (void * context);
+			void * context;
+			volatile Status status;
+			Transaction * next;
+
+			Transaction (void);
+			Transaction (SPIDevice & device, void * command, uint16_t command_length, void * tx_buffer, void * rx_buffer, uint16_t length);
+			bool isDone (void);
+		};
+
+	private:
+		SPI & _spi;
+		Transaction * volatile _head;
+		Transaction * _tail;
+		bool _command_phase;
+		bool _configured;
+		SPIDevice::Configuration _configuration;
+		uint32_t _reconfigurations;
+
+	private:
+		static void handleCompletion (void * context);
+		void _start (void);
+		bool _transfer (void * tx_buffer, void * rx_buffer, uint16_t length);
+		void _finish (Status status);
+
+	public:
+		SPIBus (SPI & spi);
+		SPIBus (SPIBus const&) = delete;
+		void operator= (SPIBus const&) = delete;
+
+		bool submit (Transaction & transaction);
+		bool isBusy (void);
+		uint32_t getNumberOfReconfigurations (void);
+	};
+}
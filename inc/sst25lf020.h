@@ -2,6 +2,7 @@
 
 #include "spi.h"
 #include "pin.h"
+#include "dma.h"
 
 using namespace System;
 
@@ -11,17 +12,129 @@ private:
 	SPI & _spi;
 	Pin & _pin_ss;
 
+	// Optional DMA channels for reads on an SSP
+	SSP * _ssp;
+	DMA * _tx_dma;
+	DMA * _rx_dma;
+
+	// Ongoing read
+	uint8_t _command[5];
+	uint8_t * _buffer;
+	uint32_t _length;
+	volatile bool _busy;
+
+	// Handler of the SPI owner (e.g. an SPIBus), restored once the read is done
+	void (*_previous_handler) (void * context);
+	void * _previous_context;
+
+	// Ongoing program/erase (the status is polled to advance it)
+	bool _writing;
+	bool _aai;
+	const uint8_t * _program_data;
+	uint32_t _program_length;
+
+private:
+	static void handleCompletion (void * context) {
+		SST25LF020 * flash = (SST25LF020 *) context;
+
+		// The chip keeps streaming as long as it is selected, so just continue with the next part
+		if (flash->_length != 0) {
+			flash->_readNext();
+			return;
+		}
+
+		// Done
+		flash->deselect();
+		flash->_restoreHandler();
+		flash->_busy = false;
+	}
+
+	void _readNext (void) {
+
+		// A DMA chain is limited by its number of segments, an interrupt driven transfer by its 16-bit length
+		uint32_t length = _length;
+		bool started;
+		if (_ssp != nullptr) {
+			if (length > (0xFFF * DMA_MAXIMUM_NUMBER_OF_SEGMENTS)) {
+				length = 0xFFF * DMA_MAXIMUM_NUMBER_OF_SEGMENTS;
+			}
+			_length -= length;
+			started = _ssp->receive(_buffer, length, *_tx_dma, *_rx_dma);
+		} else {
+			if (length > 0xFFFF) {
+				length = 0xFFFF;
+			}
+			_length -= length;
+			started = _spi.receive(_buffer, length, SPI::TransferMode::interrupt_driven);
+		}
+		_buffer += length;
+
+		// Should not happen, as the SPI was just released
+		if (!started) {
+			_length = 0;
+			handleCompletion(this);
+		}
+	}
+
+	void _restoreHandler (void) {
+		if (_previous_handler != nullptr) {
+			_spi.attachHandler(_previous_handler, _previous_context);
+		} else {
+			_spi.detachHandler();
+		}
+	}
+
+	// Short commands are polled, they take less time than an interrupt
+	void _send (uint8_t * command, uint32_t length) {
+		select();
+		_spi.transmit(command, length, SPI::TransferMode::polled);
+		deselect();
+	}
+
+	bool _startWrite (uint8_t * command, uint32_t length) {
+		if (_busy || _spi.isBusy()) {
+			return false;
+		}
+
+		// Write-Enable, then the program/erase command
+		uint8_t write_enable = 0x06;
+		_send(&write_enable, 1);
+		_send(command, length);
+		_busy = true;
+		_writing = true;
+		return true;
+	}
+
 public:
 
 	SST25LF020 (SPI & spi, Pin & pin_ss) : _spi(spi), _pin_ss(pin_ss) {
 		// Note: the SPI must already be initialized, as we cannot determine which initializer method is available!
 		// Moreover, the SPI can be shared with other chips, and should not be initialized each time!
+		_ssp = nullptr;
+		_tx_dma = nullptr;
+		_rx_dma = nullptr;
+		_buffer = nullptr;
+		_length = 0;
+		_busy = false;
+		_previous_handler = nullptr;
+		_previous_context = nullptr;
+		_writing = false;
+		_aai = false;
+		_program_data = nullptr;
+		_program_length = 0;
 
 		// Initialize the SS pin, and de-select the chip
 		_pin_ss.setDirection(Pin::Direction::output);
 		deselect();
 	}
 
+	// Reads are streamed by DMA (the RX channel should have the higher priority)
+	SST25LF020 (SSP & ssp, Pin & pin_ss, DMA & tx_dma, DMA & rx_dma) : SST25LF020(ssp, pin_ss) {
+		_ssp = &ssp;
+		_tx_dma = &tx_dma;
+		_rx_dma = &rx_dma;
+	}
+
 	void select (void) {
 		_pin_ss.clear();
 	}
@@ -34,6 +147,18 @@ public:
 		return 33000000;
 	}
 
+	static uint32_t getSize (void) {
+		return 256 * 1024;
+	}
+
+	static uint32_t getSectorSize (void) {
+		return 4 * 1024;
+	}
+
+	static uint32_t getBlockSize (void) {
+		return 32 * 1024;
+	}
+
 	static bool isCPOL (void) {
 		return false;
 	}
@@ -46,10 +171,144 @@ public:
 		return false;
 	}
 
+	// A program/erase is advanced by polling the chip, so keep calling this (or poll()) until it returns false
+	bool isBusy (void) {
+		return _writing ? poll() : _busy;
+	}
+
+	// Check the chip once and continue the program/erase if it is ready, never waits
+	bool poll (void) {
+		if (!_writing) {
+			return _busy;
+		}
+		if (_spi.isBusy()) {
+			return true;
+		}
+
+		// Read-Status-Register, the chip is still busy programming/erasing
+		uint8_t tx_buffer[2] = {0x05, 0x00};
+		uint8_t rx_buffer[2];
+		select();
+		_spi.transceive(tx_buffer, rx_buffer, 2, SPI::TransferMode::polled);
+		deselect();
+		if (rx_buffer[1] & (1 << 0)) {
+			return true;
+		}
+
+		// AAI program the next byte, the address is incremented by the chip
+		if (_program_length != 0) {
+			uint8_t command[2] = {0xAF, *_program_data};
+			_send(command, 2);
+			_program_data++;
+			_program_length--;
+			return true;
+		}
+
+		// Leave AAI mode with Write-Disable
+		if (_aai) {
+			uint8_t write_disable = 0x04;
+			_send(&write_disable, 1);
+			_aai = false;
+		}
+		_writing = false;
+		_busy = false;
+		return false;
+	}
+
+	// Clear the block protection bits (all memory is protected after power-up)
+	bool unprotect (void) {
+		if (_busy || _spi.isBusy()) {
+			return false;
+		}
+
+		// Enable-Write-Status-Register, then Write-Status-Register
+		uint8_t enable_write_status = 0x50;
+		uint8_t command[2] = {0x01, 0x00};
+		_send(&enable_write_status, 1);
+		_send(command, 2);
+		return true;
+	}
+
+	// Erase the 4 kB sector containing the address
+	bool eraseSector (uint32_t address) {
+		if (address >= getSize()) {
+			return false;
+		}
+		uint8_t command[4] = {0x20, (uint8_t) (address >> 16), (uint8_t) (address >> 8), (uint8_t) address};
+		return _startWrite(command, 4);
+	}
+
+	// Erase the 32 kB block containing the address
+	bool eraseBlock (uint32_t address) {
+		if (address >= getSize()) {
+			return false;
+		}
+		uint8_t command[4] = {0x52, (uint8_t) (address >> 16), (uint8_t) (address >> 8), (uint8_t) address};
+		return _startWrite(command, 4);
+	}
+
+	bool eraseChip (void) {
+		uint8_t command = 0x60;
+		return _startWrite(&command, 1);
+	}
+
+	// Start programming (erased) memory with Auto-Address-Increment, only the first byte carries the address
+	// The data must stay valid until isBusy() returns false
+	bool program (uint32_t address, const uint8_t * data, uint32_t length) {
+		if ((address >= getSize()) || (length > (getSize() - address))) {
+			return false;
+		}
+		if (length == 0) {
+			return true;
+		}
+		uint8_t command[5] = {0xAF, (uint8_t) (address >> 16), (uint8_t) (address >> 8), (uint8_t) address, data[0]};
+		if (!_startWrite(command, 5)) {
+			return false;
+		}
+		_aai = true;
+		_program_data = data + 1;
+		_program_length = length - 1;
+		return true;
+	}
+
+	// Start reading from the given address, the read is done once isBusy() returns false
+	// The SPI is used exclusively until then, its completion handler (e.g. of an SPIBus) is restored afterwards
+	bool read (uint32_t address, uint8_t * buffer, uint32_t length) {
+		if (_busy || _spi.isBusy() || (address >= getSize()) || (length > (getSize() - address))) {
+			return false;
+		}
+		if (length == 0) {
+			return true;
+		}
+		_busy = true;
+		_buffer = buffer;
+		_length = length;
+
+		// High-Speed-Read: 3 address bytes and a dummy byte
+		_command[0] = 0x0B;
+		_command[1] = (uint8_t) (address >> 16);
+		_command[2] = (uint8_t) (address >> 8);
+		_command[3] = (uint8_t) address;
+		_command[4] = 0x00;
+
+		// The short command is written by the CPU, its completion starts the payload transfer
+		_spi.getHandler(_previous_handler, _previous_context);
+		_spi.attachHandler(handleCompletion, this);
+		select();
+		if (!_spi.transmit(_command, sizeof(_command), SPI::TransferMode::polled)) {
+			deselect();
+			_restoreHandler();
+			_busy = false;
+			return false;
+		}
+		return true;
+	}
+
 	uint16_t readID (void) {
 		uint8_t tx_buffer[4] = {0x90, 0x00, 0x00, 0x00};
 		uint8_t rx_buffer[2];
 
+		while (isBusy()) {}
 		while (_spi.isBusy()) {}
 		select();
 		_spi.transmit(tx_buffer, 4);
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <cstring>
+#include "sst25lf020.h"
+
+using namespace System;
+
+// RAM page cache in front of the SST25LF020, with LRU replacement and sequential read-ahead
+// All programs and erases must go through the cache, so the affected pages are invalidated
+template<uint32_t PAGE_SIZE = 256, uint32_t NUMBER_OF_PAGES = 8>
+class SST25LF020Cache {
+
+	static_assert((PAGE_SIZE != 0) && ((PAGE_SIZE & (PAGE_SIZE - 1)) == 0) && (PAGE_SIZE <= 4096), "Cache page size must be a power of two up to the sector size");
+	static_assert(NUMBER_OF_PAGES >= 2, "Cache needs at least 2 pages (one can be reading ahead)");
+
+private:
+	static constexpr uint32_t _invalid = 0xFFFFFFFF;
+
+	SST25LF020 & _flash;
+	uint8_t _pages[NUMBER_OF_PAGES][PAGE_SIZE];
+	uint32_t _tags[NUMBER_OF_PAGES];
+	uint32_t _used[NUMBER_OF_PAGES];
+	uint32_t _clock;
+	uint32_t _last_page;
+	uint32_t _read_ahead_slot;
+
+	// Statistics
+	uint32_t _hits;
+	uint32_t _misses;
+	uint32_t _read_aheads;
+
+private:
+	uint32_t _find (uint32_t page) {
+		for (uint32_t i = 0; i < NUMBER_OF_PAGES; i++) {
+			if (_tags[i] == page) {
+				return i;
+			}
+		}
+		return NUMBER_OF_PAGES;
+	}
+
+	uint32_t _victim (void) {
+
+		// An empty page, or else the least recently used one (never the one being read ahead)
+		uint32_t victim = NUMBER_OF_PAGES;
+		for (uint32_t i = 0; i < NUMBER_OF_PAGES; i++) {
+			if (i == _read_ahead_slot) {
+				continue;
+			}
+			if (_tags[i] == _invalid) {
+				return i;
+			}
+			if ((victim == NUMBER_OF_PAGES) || ((int32_t) (_used[i] - _used[victim]) < 0)) {
+				victim = i;
+			}
+		}
+		return victim;
+	}
+
+	// Wait for the flash to finish what it is doing, which completes a read-ahead
+	void _wait (void) {
+		while (_flash.isBusy()) {}
+		_read_ahead_slot = NUMBER_OF_PAGES;
+	}
+
+	uint32_t _load (uint32_t page) {
+		_wait();
+		uint32_t slot = _victim();
+		_tags[slot] = _invalid;
+		if (!_flash.read(page, _pages[slot], PAGE_SIZE)) {
+			return NUMBER_OF_PAGES;
+		}
+		while (_flash.isBusy()) {}
+		_tags[slot] = page;
+		return slot;
+	}
+
+	void _readAhead (uint32_t page) {
+
+		// Only when the flash is idle, so the caller never waits for it here
+		if ((page >= SST25LF020::getSize()) || (_read_ahead_slot != NUMBER_OF_PAGES) || (_find(page) != NUMBER_OF_PAGES) || _flash.isBusy()) {
+			return;
+		}
+		// The victim keeps its page when the read is not started
+		uint32_t slot = _victim();
+		if (!_flash.read(page, _pages[slot], PAGE_SIZE)) {
+			return;
+		}
+		_tags[slot] = page;
+		_used[slot] = ++_clock;
+		_read_ahead_slot = slot;
+		_read_aheads++;
+	}
+
+	void _invalidate (uint32_t address, uint32_t length) {
+		_wait();
+		for (uint32_t i = 0; i < NUMBER_OF_PAGES; i++) {
+			if ((_tags[i] != _invalid) && ((_tags[i] + PAGE_SIZE) > address) && (_tags[i] < (address + length))) {
+				_tags[i] = _invalid;
+			}
+		}
+	}
+
+public:
+	SST25LF020Cache (SST25LF020 & flash) : _flash(flash) {
+		_clock = 0;
+		_last_page = _invalid;
+		_read_ahead_slot = NUMBER_OF_PAGES;
+		for (uint32_t i = 0; i < NUMBER_OF_PAGES; i++) {
+			_tags[i] = _invalid;
+			_used[i] = 0;
+		}
+		resetStatistics();
+	}
+	SST25LF020Cache (SST25LF020Cache const&) = delete;
+	void operator= (SST25LF020Cache const&) = delete;
+
+	// Copy from the cache, a miss waits for the page to be read (and for a program/erase to finish)
+	bool read (uint32_t address, uint8_t * buffer, uint32_t length) {
+		if ((address >= SST25LF020::getSize()) || (length > (SST25LF020::getSize() - address))) {
+			return false;
+		}
+		while (length != 0) {
+			uint32_t page = address & ~(PAGE_SIZE - 1);
+			uint32_t offset = address - page;
+			uint32_t part = PAGE_SIZE - offset;
+			if (part > length) {
+				part = length;
+			}
+
+			// A page being read ahead counts as a hit, it only waits for the rest of that page
+			uint32_t slot = _find(page);
+			if (slot == NUMBER_OF_PAGES) {
+				_misses++;
+				slot = _load(page);
+				if (slot == NUMBER_OF_PAGES) {
+					return false;
+				}
+			} else {
+				_hits++;
+				if (slot == _read_ahead_slot) {
+					_wait();
+				}
+			}
+			_used[slot] = ++_clock;
+			memcpy(buffer, &(_pages[slot][offset]), part);
+
+			// Sequential access, get the next page in the background
+			if (page == (_last_page + PAGE_SIZE)) {
+				_readAhead(page + PAGE_SIZE);
+			}
+			_last_page = page;
+
+			address += part;
+			buffer += part;
+			length -= part;
+		}
+		return true;
+	}
+
+	bool isBusy (void) {
+		return _flash.isBusy();
+	}
+
+	// Programs/erases, the affected pages are dropped from the cache
+	bool program (uint32_t address, const uint8_t * data, uint32_t length) {
+		_invalidate(address, length);
+		return _flash.program(address, data, length);
+	}
+
+	bool eraseSector (uint32_t address) {
+		address &= ~(SST25LF020::getSectorSize() - 1);
+		_invalidate(address, SST25LF020::getSectorSize());
+		return _flash.eraseSector(address);
+	}
+
+	bool eraseBlock (uint32_t address) {
+		address &= ~(SST25LF020::getBlockSize() - 1);
+		_invalidate(address, SST25LF020::getBlockSize());
+		return _flash.eraseBlock(address);
+	}
+
+	bool eraseChip (void) {
+		_invalidate(0, SST25LF020::getSize());
+		return _flash.eraseChip();
+	}
+
+	void invalidate (void) {
+		_invalidate(0, SST25LF020::getSize());
+	}
+
+	// Statistics, to size the cache
+	uint32_t getNumberOfHits (void) {
+		return _hits;
+	}
+
+	uint32_t getNumberOfMisses (void) {
+		return _misses;
+	}
+
+	uint32_t getNumberOfReadAheads (void) {
+		return _read_aheads;
+	}
+
+	void resetStatistics (void) {
+		_hits = 0;
+		_misses = 0;
+		_read_aheads = 0;
+	}
+};
@@ -3,6 +3,7 @@
 #include "pin.h"
 #include "clock.h"
 #include "dma.h"
+#include "ring_buffer.h"
 
 namespace System {
 
@@ -33,45 +34,71 @@ namespace System {
 			low = 7,
 		} Parity;
 
+		typedef RingBufferBase<uint8_t>::Span Span;
+
+		typedef enum {
+			trigger_1_char = 0,
+			trigger_4_chars = 1,
+			trigger_8_chars = 2,
+			trigger_14_chars = 3
+		} ReceiveTriggerLevel;
+
 	private:
 		LPC_UART_TypeDef * _lpc_uart;
 
 		// UART RX
 		DMA * _rx_dma_handle;
-		uint8_t * _rx_buffer;
-		uint16_t _rx_buffer_size;
-		uint16_t _rx_read_index;
-		uint16_t _rx_write_index;
+		RingBufferBase<uint8_t> _rx_ring;
 
 		// UART TX
 		DMA * _tx_dma_handle;
 		uint8_t * _tx_buffer;
 		volatile uint16_t _tx_length;
 		volatile bool _tx_busy;
+		volatile uint32_t _tx_interrupt_count;
+		volatile uint32_t _tx_byte_count;
+
+		// UART TX queue
+		RingBufferBase<uint8_t> _tx_ring;
+		volatile uint16_t _tx_ring_in_flight;
 
 	private:
 		virtual void configureReceiveDMA (DMA * dma) {};
 		virtual void configureTransmitDMA (DMA * dma) {};
+		void _fillTransmitFIFO (void);
+		bool _transmitFromQueue (void);
 
 	protected:
 		UART (uint32_t instance);
-		void initialize (uint32_t pin_txd_index, GPIO::Function function, uint32_t peripheral_frequency, uint32_t baudrate, uint8_t mode);
+		void initialize (uint32_t pin_txd_index, GPIO::Function function, uint32_t peripheral_frequency, uint32_t baudrate, uint8_t mode, ReceiveTriggerLevel trigger_level);
 		uint8_t mode (CharacterLength character_length, StopBits stop_bits, Parity parity, bool enable_break_control);
 		void setBaudrate (uint32_t peripheral_frequency, uint32_t baudrate);
 		void handle (void);
 
 	public:
 
-		// UART RX (optionally with DMA)
+		// UART RX (optionally with DMA, falls back to interrupts and returns false if the DMA cannot take the buffer)
 		void receive (uint8_t * rx_buffer, uint16_t rx_buffer_size);
-		void receive (uint8_t * rx_buffer, uint16_t rx_buffer_size, DMA & dma);
+		bool receive (uint8_t * rx_buffer, uint16_t rx_buffer_size, DMA & dma);
 		uint16_t bytesAvailable (void);
 		uint8_t getChar (void);
+		uint16_t peek (Span & first, Span & second);
+		void consume (uint16_t length);
 
 		// UART TX (optionally with DMA)
 		bool transmit (uint8_t * tx_buffer, uint16_t tx_length);
 		bool transmit (uint8_t * tx_buffer, uint16_t tx_length, DMA & dma);
 		bool isTransmitting (void);
+
+		// UART TX queue (optionally with DMA), transmit() then only fails if the data does not fit
+		void transmitQueue (uint8_t * tx_queue_buffer, uint16_t tx_queue_size);
+		void transmitQueue (uint8_t * tx_queue_buffer, uint16_t tx_queue_size, DMA & dma);
+		uint16_t write (const uint8_t * data, uint16_t length);
+		uint16_t bytesFree (void);
+
+		// UART TX statistics (interrupt driven transfers only)
+		uint32_t getTransmitInterruptCount (void);
+		uint32_t getTransmitByteCount (void);
 	};
 
 	/************************************
@@ -94,7 +121,8 @@ namespace System {
 						UART::CharacterLength character_length = UART::CharacterLength::char_8b,
 						UART::StopBits stop_bits = UART::StopBits::stop_1,
 						UART::Parity parity = UART::Parity::none,
-						bool enable_break_control = false);
+						bool enable_break_control = false,
+						UART::ReceiveTriggerLevel trigger_level = UART::ReceiveTriggerLevel::trigger_1_char);
 	};
 
 	/************************************
@@ -124,7 +152,8 @@ namespace System {
 				UART::StopBits stop_bits = UART::StopBits::stop_1,
 				UART::Parity parity = UART::Parity::none,
 				bool enable_break_control = false,
-				PinSelection pin_selection = p0_15_and_p0_16);
+				PinSelection pin_selection = p0_15_and_p0_16,
+				UART::ReceiveTriggerLevel trigger_level = UART::ReceiveTriggerLevel::trigger_1_char);
 	};
 
 	/************************************
@@ -154,7 +183,8 @@ namespace System {
 				UART::StopBits stop_bits = UART::StopBits::stop_1,
 				UART::Parity parity = UART::Parity::none,
 				bool enable_break_control = false,
-				PinSelection pin_selection = p0_10_and_p0_11);
+				PinSelection pin_selection = p0_10_and_p0_11,
+				UART::ReceiveTriggerLevel trigger_level = UART::ReceiveTriggerLevel::trigger_1_char);
 	};
 
 	/************************************
@@ -185,6 +215,7 @@ namespace System {
 				UART::StopBits stop_bits = UART::StopBits::stop_1,
 				UART::Parity parity = UART::Parity::none,
 				bool enable_break_control = false,
-				PinSelection pin_selection = p0_0_and_p0_1);
+				PinSelection pin_selection = p0_0_and_p0_1,
+				UART::ReceiveTriggerLevel trigger_level = UART::ReceiveTriggerLevel::trigger_1_char);
 	};
 }
@@ -20,20 +20,72 @@ typedef struct
 
 #define LPC_GPDMACH ((LPC_GPDMACHN_TypeDef *) LPC_GPDMACH0_BASE)
 
+namespace {
+
+	// Maximum number of transfers in a single descriptor (12-bit TransferSize)
+	const uint32_t _maximum_segment_size = 0xFFF;
+
+	// Channel pool administration
+	volatile uint8_t _allocated_channels = 0;
+	volatile uint16_t _allocated_request_lines = 0;
+
+	bool _isSourcePeripheral (DMA::TransferType transfer_type) {
+		return ((transfer_type == DMA::TransferType::peripheral_to_memory) || (transfer_type == DMA::TransferType::peripheral_to_peripheral));
+	}
+
+	bool _isDestinationPeripheral (DMA::TransferType transfer_type) {
+		return ((transfer_type == DMA::TransferType::memory_to_peripheral) || (transfer_type == DMA::TransferType::peripheral_to_peripheral));
+	}
+
+	uint16_t _getRequestLines (DMA::TransferType transfer_type, DMA::Peripheral source_peripheral, DMA::Peripheral destination_peripheral) {
+
+		// NOTE: UART and timer match requests share lines 8-15 (selected by DMAREQSEL), so they conflict as well
+		uint16_t request_lines = 0;
+		if (_isSourcePeripheral(transfer_type)) {
+			request_lines |= (1 << (((uint32_t) source_peripheral) & 0x0F));
+		}
+		if (_isDestinationPeripheral(transfer_type)) {
+			request_lines |= (1 << (((uint32_t) destination_peripheral) & 0x0F));
+		}
+		return request_lines;
+	}
+
+	void _selectRequestLine (DMA::Peripheral peripheral) {
+
+		// Only lines 8-15 are shared between UART and timer match requests
+		if (peripheral & (1 << 3)) {
+			if (peripheral & (1 << 4)) {
+				LPC_SC->DMAREQSEL |= (1 << (((uint32_t) peripheral) & 0x07));
+			} else {
+				LPC_SC->DMAREQSEL &= ~(1 << (((uint32_t) peripheral) & 0x07));
+			}
+		}
+	}
+}
+
 /************************************
 * DMA Interrupt Handlers			*
 ************************************/
 
-void (*_handleInterruptPointerDMA[8]) (void) = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
+void (*_handleInterruptPointerDMA[8]) (bool terminal_count, bool error) = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr};
 
 extern "C" {
 
 	void DMA_IRQHandler (void) {
-		for (uint32_t channel = 0; channel < 8; channel++) {
-			if (LPC_GPDMA->DMACIntStat & (1 << channel)) {
-				if (_handleInterruptPointerDMA[channel] != nullptr) {
-					_handleInterruptPointerDMA[channel]();
-				}
+
+		// Read and clear the status of all channels at once
+		uint32_t terminal_count = LPC_GPDMA->DMACIntTCStat;
+		uint32_t error = LPC_GPDMA->DMACIntErrStat;
+		LPC_GPDMA->DMACIntTCClear = terminal_count;
+		LPC_GPDMA->DMACIntErrClr = error;
+
+		// Only dispatch the flagged channels, in order of priority (lowest channel number first)
+		uint32_t pending = terminal_count | error;
+		while (pending != 0) {
+			uint32_t channel = __CLZ(__RBIT(pending));
+			pending &= ~(1 << channel);
+			if (_handleInterruptPointerDMA[channel] != nullptr) {
+				_handleInterruptPointerDMA[channel]((terminal_count >> channel) & 1, (error >> channel) & 1);
 			}
 		}
 	}
@@ -50,34 +102,46 @@ namespace System {
 		_channel = (uint8_t) channel;
 		_control = 0;
 		_config = 0;
+		_first = 0;
+		_total = 0;
+		_completed = 0;
+		_errors = 0;
+		_request_lines = 0;
+		_handler = nullptr;
+		_handler_context = nullptr;
+		_half_completed_event = false;
+		_half_completed_next = false;
+		_circular = false;
 	}
 
-	void DMA::handle (void) {
+	void DMA::handle (bool terminal_count, bool error) {
+
+		// NOTE: the interrupt flags are already cleared by the DMA_IRQHandler
+		if (terminal_count) {
 
-		if (LPC_GPDMA->DMACIntTCStat & (1 << _channel)) {
+			// A descriptor with the interrupt flag set is done, the hardware already continues with the next
+			_completed++;
 
-			// Reset source/destination addresses if auto-increment was enabled (correct for data size)
-			uint32_t number_of_transfers_to_reset = getTotalNumberOfTransfers() - 1;
-			if (_control & (1 << 26)) {
-				LPC_GPDMACH[_channel].DMACCSrcAddr -= number_of_transfers_to_reset << ((_control >> 18) & 0x03);
+			// The interrupts of transfer() alternate between the first half (if requested) and the end
+			DMA::Event event = DMA::Event::completed;
+			if (_half_completed_next) {
+				event = DMA::Event::half_completed;
+				_half_completed_next = false;
+			} else {
+				_half_completed_next = _half_completed_event && _circular;
 			}
-			if (_control & (1 << 27)) {
-				LPC_GPDMACH[_channel].DMACCDestAddr -= number_of_transfers_to_reset << ((_control >> 21) & 0x03);
+			if (_handler != nullptr) {
+				_handler(event, _handler_context);
 			}
-
-			// Re-enable the channel (_control contains the size, _config the enable bit)
-			LPC_GPDMACH[_channel].DMACCControl = _control;
-			LPC_GPDMACH[_channel].DMACCConfig = _config;
-
-			// Clear the terminal count interrupt
-			LPC_GPDMA->DMACIntTCClear = (1 << _channel);
 		}
 
-		if (LPC_GPDMA->DMACIntErrStat & (1 << _channel)) {
+		if (error) {
 
-			// NOTE: this should never happen, as the interrupt is masked
-			// Clear the error status interrupt
-			LPC_GPDMA->DMACIntErrClr = (1 << _channel);
+			// The hardware has disabled the channel
+			_errors++;
+			if (_handler != nullptr) {
+				_handler(DMA::Event::error, _handler_context);
+			}
 		}
 	}
 
@@ -112,6 +176,100 @@ namespace System {
 		Clock::disablePeripheral(Clock::PeripheralPower::dma_power);
 	}
 
+	bool DMA::isEnabled (void) {
+		return ((LPC_GPDMA->DMACConfig & (1 << 0)) != 0);
+	}
+
+	DMA & DMA::getChannel (DMA::Channel channel) {
+		switch (channel) {
+		case DMA::Channel::ch_0:
+			return DMAChannel<DMA::Channel::ch_0>::instance();
+		case DMA::Channel::ch_1:
+			return DMAChannel<DMA::Channel::ch_1>::instance();
+		case DMA::Channel::ch_2:
+			return DMAChannel<DMA::Channel::ch_2>::instance();
+		case DMA::Channel::ch_3:
+			return DMAChannel<DMA::Channel::ch_3>::instance();
+		case DMA::Channel::ch_4:
+			return DMAChannel<DMA::Channel::ch_4>::instance();
+		case DMA::Channel::ch_5:
+			return DMAChannel<DMA::Channel::ch_5>::instance();
+		case DMA::Channel::ch_6:
+			return DMAChannel<DMA::Channel::ch_6>::instance();
+		default: // (channel == DMA::Channel::ch_7)
+			return DMAChannel<DMA::Channel::ch_7>::instance();
+		}
+	}
+
+	DMA * DMA::allocate (bool high_priority) {
+		return allocate(DMA::TransferType::memory_to_memory, DMA::Peripheral::unused, DMA::Peripheral::unused, high_priority);
+	}
+
+	DMA * DMA::allocate (DMA::TransferType transfer_type, DMA::Peripheral source_peripheral, DMA::Peripheral destination_peripheral, bool high_priority) {
+		uint16_t request_lines = _getRequestLines(transfer_type, source_peripheral, destination_peripheral);
+
+		// Find a free channel, from the highest priority channel upwards or from the lowest priority channel downwards
+		int32_t channel = -1;
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		if ((_allocated_request_lines & request_lines) == 0) {
+			for (uint32_t i = 0; i < 8; i++) {
+				uint32_t candidate = high_priority ? i : (7 - i);
+				if ((_allocated_channels & (1 << candidate)) == 0) {
+					_allocated_channels |= (1 << candidate);
+					_allocated_request_lines |= request_lines;
+					channel = candidate;
+					break;
+				}
+			}
+		}
+		__set_PRIMASK(primask);
+
+		// No channel available, or the request line(s) are in use
+		if (channel < 0) {
+			return nullptr;
+		}
+
+		DMA & dma = getChannel((DMA::Channel) channel);
+		dma._request_lines = request_lines;
+		return &dma;
+	}
+
+	bool DMA::claim (DMA::TransferType transfer_type, DMA::Peripheral source_peripheral, DMA::Peripheral destination_peripheral) {
+		uint16_t request_lines = _getRequestLines(transfer_type, source_peripheral, destination_peripheral);
+
+		// Reserve this specific channel, so it will not be handed out by allocate()
+		bool claimed = false;
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		if (((_allocated_channels & (1 << _channel)) == 0) && ((_allocated_request_lines & request_lines) == 0)) {
+			_allocated_channels |= (1 << _channel);
+			_allocated_request_lines |= request_lines;
+			_request_lines = request_lines;
+			claimed = true;
+		}
+		__set_PRIMASK(primask);
+		return claimed;
+	}
+
+	void DMA::release (void) {
+
+		// Make sure the channel is disabled
+		LPC_GPDMACH[_channel].DMACCConfig = 0;
+
+		// Return the channel and its request line(s) to the pool
+		// The next owner starts without the handler of this one, so it is cleared before the channel can be allocated again
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		_handler = nullptr;
+		_handler_context = nullptr;
+		_half_completed_event = false;
+		_allocated_channels &= ~(1 << _channel);
+		_allocated_request_lines &= ~_request_lines;
+		_request_lines = 0;
+		__set_PRIMASK(primask);
+	}
+
 	void DMA::configure (DMA::TransferType transfer_type,
 			DMA::Peripheral source_peripheral,
 			DMA::Peripheral destination_peripheral,
@@ -131,52 +289,165 @@ namespace System {
 				(((uint32_t) destination_increment) << 27));
 
 		// Prepare the configuration word
-		if (source_peripheral & (1 << 4)) {
-			LPC_SC->DMAREQSEL |= (1 << (((uint32_t) source_peripheral) & 0x07));
-		} else {
-			LPC_SC->DMAREQSEL &= ~(1 << (((uint32_t) source_peripheral) & 0x07));
+		if (_isSourcePeripheral(transfer_type)) {
+			_selectRequestLine(source_peripheral);
 		}
-		if (destination_peripheral & (1 << 4)) {
-			LPC_SC->DMAREQSEL |= (1 << (((uint32_t) destination_peripheral) & 0x07));
-		} else {
-			LPC_SC->DMAREQSEL &= ~(1 << (((uint32_t) destination_peripheral) & 0x07));
+		if (_isDestinationPeripheral(transfer_type)) {
+			_selectRequestLine(destination_peripheral);
 		}
 		this->_config = ((((uint32_t) source_peripheral) & 0x0F) << 1) |
 				((((uint32_t) destination_peripheral) & 0x0F) << 6) |
-				(((uint32_t) transfer_type) << 11) | (1 << 0) | (1 << 15);
+				(((uint32_t) transfer_type) << 11) | (1 << 0) | (1 << 14) | (1 << 15);
 	}
 
-	void DMA::transfer (volatile void * source, volatile void * destination, uint32_t number_of_transfers, bool auto_re_enable) {
+	bool DMA::transfer (volatile void * source, volatile void * destination, uint32_t number_of_transfers, bool auto_re_enable) {
 
-		// Make sure the channel is disabled
-		LPC_GPDMACH[_channel].DMACCConfig = 0;
+		// Only interrupt (halfway and at the end) if there is a handler to notify
+		bool half_completed_event = (_handler != nullptr) && _half_completed_event && (number_of_transfers > 1);
+		uint32_t half = half_completed_event ? (number_of_transfers >> 1) : 0;
 
-		// Clear any pending interrupts
+		// Split into segments of at most 4095 transfers, chained by the hardware
+		uint32_t number_of_segments = 0;
+		if (!_prepareSegments(number_of_segments, source, destination, 0, half, true) ||
+				!_prepareSegments(number_of_segments, source, destination, half, number_of_transfers - half, _handler != nullptr)) {
+			return false;
+		}
+		if (number_of_segments == 0) {
+			prepare(_segments[0], source, destination, 0);
+			number_of_segments = 1;
+		}
+
+		// Auto re-enable links the last segment back to the first, so the hardware restarts without CPU involvement
+		link(_segments, number_of_segments, auto_re_enable);
+		_transfer(_segments[0], half_completed_event, auto_re_enable);
+		return true;
+	}
+
+	void DMA::abort (void) {
+
+		// Stop the channel, and drop its pending interrupts
+		LPC_GPDMACH[_channel].DMACCConfig = 0;
 		LPC_GPDMA->DMACIntTCClear = (1 << _channel);
 		LPC_GPDMA->DMACIntErrClr = (1 << _channel);
+	}
+
+	bool DMA::_prepareSegments (uint32_t & number_of_segments, volatile void * source, volatile void * destination, uint32_t offset, uint32_t number_of_transfers, bool interrupt) {
+
+		// Only incrementing addresses advance (correct for data size)
+		uint32_t source_shift = (_control & (1 << 26)) ? ((_control >> 18) & 0x03) : 32;
+		uint32_t destination_shift = (_control & (1 << 27)) ? ((_control >> 21) & 0x03) : 32;
+
+		while (number_of_transfers != 0) {
+			if (number_of_segments >= DMA_MAXIMUM_NUMBER_OF_SEGMENTS) {
+				return false;
+			}
+			uint32_t size = (number_of_transfers > _maximum_segment_size) ? _maximum_segment_size : number_of_transfers;
+			number_of_transfers -= size;
+			prepare(_segments[number_of_segments++],
+					(volatile uint8_t *) source + ((source_shift < 32) ? (offset << source_shift) : 0),
+					(volatile uint8_t *) destination + ((destination_shift < 32) ? (offset << destination_shift) : 0),
+					size, interrupt && (number_of_transfers == 0));
+			offset += size;
+		}
+		return true;
+	}
+
+	void DMA::prepare (Descriptor & descriptor, volatile void * source, volatile void * destination, uint32_t number_of_transfers, bool interrupt) {
+
+		// Use the previously prepared control word
+		descriptor.source = (uint32_t) source;
+		descriptor.destination = (uint32_t) destination;
+		descriptor.next = 0;
+		descriptor.control = (_control & ~((1 << 31) | 0x0FFF)) | (number_of_transfers & 0x0FFF) | (((uint32_t) interrupt) << 31);
+	}
 
-		// Setup the source and destination addresses
-		LPC_GPDMACH[_channel].DMACCSrcAddr = (uint32_t) source;
-		LPC_GPDMACH[_channel].DMACCDestAddr = (uint32_t) destination;
-		LPC_GPDMACH[_channel].DMACCLLI = 0;
+	void DMA::link (Descriptor * descriptors, uint32_t number_of_descriptors, bool circular) {
 
-		// Use the previously prepared control and configuration words
-		_control = (_control & ~(0x0FFF)) | number_of_transfers;
-		if (auto_re_enable) {
-			_control |= (1 << 31);
-		} else {
-			_control &= ~(1 << 31);
+		// Link each descriptor to the next, the last one (optionally) back to the first
+		for (uint32_t i = 0; i + 1 < number_of_descriptors; i++) {
+			descriptors[i].next = (uint32_t) &descriptors[i + 1];
 		}
+		if (number_of_descriptors != 0) {
+			descriptors[number_of_descriptors - 1].next = circular ? (uint32_t) &descriptors[0] : 0;
+		}
+	}
+
+	void DMA::transfer (Descriptor & first) {
+		_transfer(first, false, false);
+	}
+
+	void DMA::_transfer (Descriptor & first, bool half_completed_next, bool circular) {
+
+		// Make sure the channel is disabled
+		LPC_GPDMACH[_channel].DMACCConfig = 0;
+
+		// Clear any pending interrupts
+		LPC_GPDMA->DMACIntTCClear = (1 << _channel);
+		LPC_GPDMA->DMACIntErrClr = (1 << _channel);
+		_completed = 0;
+
+		// Determine the total size of the chain
+		_first = (uint32_t) &first;
+		_total = 0;
+		uint32_t next = _first;
+		do {
+			Descriptor * descriptor = (Descriptor *) next;
+			_total += descriptor->control & 0xFFF;
+			next = descriptor->next;
+		} while ((next != 0) && (next != _first));
+
+		// The ISR state must be in place before the channel is enabled, the first interrupt can come right away
+		_half_completed_next = half_completed_next;
+		_circular = circular;
+
+		// Load the first descriptor, the rest is loaded by the hardware
+		LPC_GPDMACH[_channel].DMACCSrcAddr = first.source;
+		LPC_GPDMACH[_channel].DMACCDestAddr = first.destination;
+		LPC_GPDMACH[_channel].DMACCLLI = first.next;
+		_control = first.control;
 		LPC_GPDMACH[_channel].DMACCControl = _control;
 		LPC_GPDMACH[_channel].DMACCConfig = _config;
 	}
 
+	uint32_t DMA::getNumberOfCompletedDescriptors (void) {
+		return _completed;
+	}
+
+	void DMA::attachHandler (void (*handler)(DMA::Event event, void * context), void * context, bool half_completed_event) {
+		_handler = nullptr;
+		_handler_context = context;
+		_half_completed_event = half_completed_event;
+		_handler = handler;
+	}
+
+	void DMA::detachHandler (void) {
+		_handler = nullptr;
+	}
+
+	uint32_t DMA::getNumberOfErrors (void) {
+		return _errors;
+	}
+
 	uint32_t DMA::getTotalNumberOfTransfers (void) {
-		return _control & 0xFFF;
+		return _total;
 	}
 
 	uint32_t DMA::getNumberOfTransfersLeft (void) {
-		return LPC_GPDMACH[_channel].DMACCControl & 0xFFF;
+
+		// Read a consistent snapshot of the current descriptor and the next one
+		uint32_t next, left;
+		do {
+			next = LPC_GPDMACH[_channel].DMACCLLI;
+			left = LPC_GPDMACH[_channel].DMACCControl & 0xFFF;
+		} while (next != LPC_GPDMACH[_channel].DMACCLLI);
+
+		// Add the descriptors that still have to be loaded (up to the end, or back to the first)
+		while ((next != 0) && (next != _first)) {
+			Descriptor * descriptor = (Descriptor *) next;
+			left += descriptor->control & 0xFFF;
+			next = descriptor->next;
+		}
+		return left;
 	}
 
 	uint32_t DMA::numberTransferred (void) {
@@ -0,0 +1,194 @@
+// Includes
+#include "eeprom_24lc.h"
+#include "i2c.h"
+
+// Namespaces
+using namespace System;
+
+EEPROM24LC::EEPROM24LC (I2C & i2c, uint8_t slave_address, uint32_t size, uint32_t page_size) : _i2c(i2c) {
+	_slave_address = slave_address & ~(1 << 0);
+	_size = size;
+	_page_size = page_size;
+	_address_length = (size > 2048) ? 2 : 1;
+	_operation = Operation::none;
+	_successful = true;
+	_address = 0;
+	_buffer = nullptr;
+	_length = 0;
+	_part = 0;
+	_polls = 0;
+}
+
+uint32_t EEPROM24LC::getSize (void) {
+	return _size;
+}
+
+uint32_t EEPROM24LC::getPageSize (void) {
+	return _page_size;
+}
+
+bool EEPROM24LC::read (uint32_t address, uint8_t * buffer, uint32_t length) {
+
+	// Check if a new operation can be started
+	if (isBusy() || (buffer == nullptr) || (address >= _size) || (length > (_size - address))) {
+		return false;
+	}
+	if (length == 0) {
+		_successful = true;
+		return true;
+	}
+	_operation = Operation::read;
+	_address = address;
+	_buffer = buffer;
+	_length = length;
+	if (!_readNext()) {
+		_operation = Operation::none;
+		return false;
+	}
+	return true;
+}
+
+bool EEPROM24LC::write (uint32_t address, const uint8_t * data, uint32_t length) {
+
+	// Check if a new operation can be started
+	if (isBusy() || (data == nullptr) || (address >= _size) || (length > (_size - address))) {
+		return false;
+	}
+	if (length == 0) {
+		_successful = true;
+		return true;
+	}
+	_operation = Operation::write;
+	_address = address;
+	_buffer = (uint8_t *) data;
+	_length = length;
+	if (!_writeNext()) {
+		_operation = Operation::none;
+		return false;
+	}
+	return true;
+}
+
+bool EEPROM24LC::isBusy (void) {
+	return (_operation != Operation::none);
+}
+
+bool EEPROM24LC::isSuccessful (void) {
+	return _successful;
+}
+
+void EEPROM24LC::handleCompletion (void * context) {
+	EEPROM24LC * eeprom = (EEPROM24LC *) context;
+	I2C::Status status = eeprom->_transaction.status;
+
+	switch (eeprom->_operation) {
+	case Operation::read:
+		if (status != I2C::Status::completed) {
+			eeprom->_finish(false);
+		} else {
+			eeprom->_address += eeprom->_part;
+			eeprom->_buffer += eeprom->_part;
+			eeprom->_length -= eeprom->_part;
+			if (eeprom->_length == 0) {
+				eeprom->_finish(true);
+			} else if (!eeprom->_readNext()) {
+				eeprom->_finish(false);
+			}
+		}
+		break;
+
+	case Operation::write:
+
+		// Page sent, the write cycle starts at the STOP
+		if (status != I2C::Status::completed) {
+			eeprom->_finish(false);
+		} else {
+			eeprom->_address += eeprom->_part;
+			eeprom->_buffer += eeprom->_part;
+			eeprom->_length -= eeprom->_part;
+			eeprom->_operation = Operation::poll;
+			eeprom->_polls = 0;
+			if (!eeprom->_poll()) {
+				eeprom->_finish(false);
+			}
+		}
+		break;
+
+	case Operation::poll:
+
+		// Not acknowledged while the write cycle is in progress
+		if (status == I2C::Status::completed) {
+			if (eeprom->_length == 0) {
+				eeprom->_finish(true);
+			} else {
+				eeprom->_operation = Operation::write;
+				if (!eeprom->_writeNext()) {
+					eeprom->_finish(false);
+				}
+			}
+		} else if ((status != I2C::Status::address_not_acknowledged) || (eeprom->_polls >= EEPROM_24LC_MAXIMUM_POLLS) || !eeprom->_poll()) {
+			eeprom->_finish(false);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+uint8_t EEPROM24LC::_setAddress (uint32_t address) {
+
+	// The memory address, small devices have the upper bits of it in the slave address
+	if (_address_length == 2) {
+		_header[0] = address >> 8;
+		_header[1] = address;
+		return _slave_address;
+	}
+	_header[0] = address;
+	return _slave_address | ((address >> 7) & 0x0E);
+}
+
+bool EEPROM24LC::_submit (uint32_t number_of_segments, uint8_t nack_retries) {
+	_transaction = I2C::Transaction(_segments, number_of_segments);
+	_transaction.nack_retries = nack_retries;
+	_transaction.handler = handleCompletion;
+	_transaction.context = this;
+	return _i2c.submit(_transaction);
+}
+
+bool EEPROM24LC::_readNext (void) {
+
+	// Sequential read, the address counter continues over the page (and block) boundaries
+	_part = (_length > 0xFFFF) ? 0xFFFF : _length;
+	uint8_t slave_address = _setAddress(_address);
+	_segments[0] = {slave_address, I2C::Segment::write, _header, (uint16_t) _address_length};
+	_segments[1] = {slave_address, I2C::Segment::read, _buffer, (uint16_t) _part};
+	return _submit(2);
+}
+
+bool EEPROM24LC::_writeNext (void) {
+
+	// Up to the end of the page, the address counter would wrap around within the page
+	_part = _page_size - (_address % _page_size);
+	if (_part > _length) {
+		_part = _length;
+	}
+	uint8_t slave_address = _setAddress(_address);
+	_segments[0] = {slave_address, I2C::Segment::write, _header, (uint16_t) _address_length};
+	_segments[1] = {slave_address, I2C::Segment::write | I2C::Segment::no_start, _buffer, (uint16_t) _part};
+	return _submit(2);
+}
+
+bool EEPROM24LC::_poll (void) {
+
+	// Only the slave address, it is acknowledged once the write cycle is done
+	// The NACK while writing is expected, so the bus does not retry it (every poll is a single probe)
+	_polls++;
+	_segments[0] = {_slave_address, I2C::Segment::write, nullptr, 0};
+	return _submit(1, 0);
+}
+
+void EEPROM24LC::_finish (bool successful) {
+	_successful = successful;
+	_operation = Operation::none;
+}
@@ -41,6 +41,51 @@ extern "C" {
 
 namespace System {
 
+	/************************************
+	* I2C::Transaction					*
+	************************************/
+
+	I2C::Transaction::Transaction (void) {
+		segments = nullptr;
+		number_of_segments = 0;
+		nack_retries = default_nack_retries;
+		retries = 0;
+		handler = nullptr;
+		context = nullptr;
+		status = Status::idle;
+		next = nullptr;
+	}
+
+	I2C::Transaction::Transaction (Segment * segments, uint32_t number_of_segments) : Transaction() {
+		this->segments = segments;
+		this->number_of_segments = number_of_segments;
+	}
+
+	I2C::Transaction::Transaction (uint8_t slave_address, uint8_t * tx_buffer, uint16_t tx_length, uint8_t * rx_buffer, uint16_t rx_length) : Transaction() {
+
+		// A write followed by a read, leaving out the empty ones
+		if (tx_length != 0) {
+			built_in[number_of_segments] = {slave_address, Segment::write, tx_buffer, tx_length};
+			number_of_segments++;
+		}
+		if (rx_length != 0) {
+			built_in[number_of_segments] = {slave_address, Segment::read, rx_buffer, rx_length};
+			number_of_segments++;
+		}
+	}
+
+	I2C::Segment * I2C::Transaction::getSegments (void) {
+		return (segments != nullptr) ? segments : built_in;
+	}
+
+	bool I2C::Transaction::isDone (void) {
+		return (status >= Status::completed);
+	}
+
+	bool I2C::Transaction::isSuccessful (void) {
+		return (status == Status::completed);
+	}
+
 	/************************************
 	* I2C Base Implementation			*
 	************************************/
@@ -53,10 +98,20 @@ namespace System {
 		} else { // (instance == 2)
 			_lpc_i2c = LPC_I2C2;
 		}
-		busy = false;
+		_head = nullptr;
+		_tail = nullptr;
+		_pin_sda = 0;
+		_function = GPIO::Function::gpio;
+		_half_period = 0;
+		_handling = false;
+		_nack_retries = I2C_NACK_RETRIES;
+		_arbitration_retries = I2C_ARBITRATION_RETRIES;
+		resetStatistics();
 	}
 
 	void I2C::initialize (uint32_t pin_sda_index, GPIO::Function function, uint32_t peripheral_frequency, Mode mode) {
+		_pin_sda = pin_sda_index;
+		_function = function;
 
 		// Init SDA pin
 		GPIOPin pin_sda(pin_sda_index);
@@ -87,39 +142,251 @@ namespace System {
 		}
 		_lpc_i2c->I2SCLL = sum - _lpc_i2c->I2SCLH;
 
+		// Half a bus clock period (in delay loops of at least 2 CPU cycles) for the bus recovery
+		_half_period = Clock::getCPUFrequency() / (4 * bus_frequency);
+
 		// Enable the I2C interface in master transmitter mode
 		_lpc_i2c->I2CONCLR = (1 << 2) | (1 << 3) | (1 << 4) | (1 << 5) | (1 << 6);
 		_lpc_i2c->I2CONSET = (1 << 6);
 	}
 
 	bool I2C::isBusy (void) {
-		return (busy || (_lpc_i2c->I2STAT != 0xF8));
+		return ((_head != nullptr) || (_lpc_i2c->I2STAT != 0xF8));
 	}
 
-	bool I2C::startTransfer (uint8_t slave_address, uint8_t * tx_buffer, uint8_t tx_length, uint8_t * rx_buffer, uint8_t rx_length) {
+	bool I2C::submit (Transaction & transaction) {
+
+		// A transaction can only be queued once
+		if ((transaction.status == Status::queued) || (transaction.status == Status::active)) {
+			return false;
+		}
+		Segment * segments = transaction.getSegments();
+		for (uint32_t i = 0; i < transaction.number_of_segments; i++) {
+			if ((segments[i].flags & Segment::read) && (segments[i].length == 0)) {
+				return false;
+			}
+		}
+		transaction.next = nullptr;
+		transaction.retries = 0;
+		if (transaction.number_of_segments == 0) {
+			transaction.status = Status::completed;
+			if (transaction.handler != nullptr) {
+				transaction.handler(transaction.context);
+			}
+			return true;
+		}
+
+		// Append to the queue, and generate the START when the queue was empty (the rest is handled in the ISR)
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		transaction.status = Status::queued;
+		if (_tail != nullptr) {
+			_tail->next = &transaction;
+		} else {
+			_head = &transaction;
+		}
+		_tail = &transaction;
+		if (_head == &transaction) {
+
+			// A slave that still holds the bus (e.g. after a reset in the middle of a read) would block the START forever
+			// Only checked when idle: from a completion handler, the interface itself still holds SCL low,
+			// and while the STOP of the previous transaction is still going out (STO set) the lines are not released yet
+			if (!_handling && (_lpc_i2c->I2STAT == 0xF8) && !(_lpc_i2c->I2CONSET & (1 << 4)) && !_isBusFree()) {
+				_recover();
+			}
+			_load(transaction);
+			_lpc_i2c->I2CONSET = (1 << 5);
+		}
+		__set_PRIMASK(primask);
+		return true;
+	}
+
+	bool I2C::startTransfer (uint8_t slave_address, uint8_t * tx_buffer, uint16_t tx_length, uint8_t * rx_buffer, uint16_t rx_length) {
 
 		// Check if a new transfer can be started
 		if (isBusy())
 			return false;
-		if ((tx_length == 0) && (rx_length == 0))
-			return true;
+
+		// Use the built-in transaction
+		_transfer = Transaction(slave_address, tx_buffer, tx_length, rx_buffer, rx_length);
+		return submit(_transfer);
+	}
+
+	void I2C::setRetries (uint8_t nack_retries, uint8_t arbitration_retries) {
+		_nack_retries = nack_retries;
+		_arbitration_retries = arbitration_retries;
+	}
+
+	bool I2C::recover (void) {
+
+		// Only when no transaction is active
+		if (_head != nullptr) {
+			return false;
+		}
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		bool free = _recover();
+		__set_PRIMASK(primask);
+		return free;
+	}
+
+	uint32_t I2C::getNumberOfNacks (void) {
+		return _nacks;
+	}
+
+	uint32_t I2C::getNumberOfArbitrationLosses (void) {
+		return _arbitration_losses;
+	}
+
+	uint32_t I2C::getNumberOfBusErrors (void) {
+		return _bus_errors;
+	}
+
+	uint32_t I2C::getNumberOfRetries (void) {
+		return _retries;
+	}
+
+	uint32_t I2C::getNumberOfRecoveries (void) {
+		return _recoveries;
+	}
+
+	void I2C::resetStatistics (void) {
+		_nacks = 0;
+		_arbitration_losses = 0;
+		_bus_errors = 0;
+		_retries = 0;
+		_recoveries = 0;
+	}
+
+	void I2C::_load (Transaction & transaction) {
+		transaction.status = Status::active;
+		_segment_end = transaction.getSegments() + transaction.number_of_segments;
+		_loadSegment(transaction.getSegments());
+	}
+
+	void I2C::_loadSegment (Segment * segment) {
 
 		// Store all settings
-		this->slave_address = (slave_address & ~(1 << 0));
-		this->tx_buffer = tx_buffer;
-		this->tx_length = tx_length;
-		this->rx_buffer = rx_buffer;
-		this->rx_length = rx_length;
+		_segment = segment;
+		_slave_address = (segment->slave_address & ~(1 << 0));
+		_buffer = segment->buffer;
+		_length = segment->length;
+	}
 
-		// Generate the START, the rest is handled in the ISR
-		_lpc_i2c->I2CONSET = (1 << 5);
+	bool I2C::_continueSegment (void) {
 
-		// The transfer was successfully started
-		busy = true;
+		// A write that continues the current write, without a repeated START
+		Segment * next = _segment + 1;
+		if ((next == _segment_end) || (_segment->flags & Segment::read) || (next->flags & Segment::read) || !(next->flags & Segment::no_start)) {
+			return false;
+		}
+		_loadSegment(next);
 		return true;
 	}
 
+	uint32_t I2C::_nextSegment (void) {
+
+		// A repeated START for the next segment, or the end of the message
+		Segment * next = _segment + 1;
+		if (next == _segment_end) {
+			return _finish(Status::completed);
+		}
+		_loadSegment(next);
+		return (1 << 5);
+	}
+
+	uint32_t I2C::_finish (Status status) {
+
+		// Restart a failed message from the first segment (after a STOP) while retries are left
+		Transaction & transaction = *_head;
+		uint8_t limit = 0;
+		if ((status == Status::address_not_acknowledged) || (status == Status::data_not_acknowledged)) {
+			limit = (transaction.nack_retries != Transaction::default_nack_retries) ? transaction.nack_retries : _nack_retries;
+		} else if (status == Status::arbitration_lost) {
+			limit = _arbitration_retries;
+		}
+		if (transaction.retries < limit) {
+			transaction.retries++;
+			_retries++;
+			_load(transaction);
+			return (1 << 4) | (1 << 5);
+		}
+
+		// Remove the active transaction from the queue, and report it
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		_head = transaction.next;
+		if (_head == nullptr) {
+			_tail = nullptr;
+		}
+		__set_PRIMASK(primask);
+		transaction.next = nullptr;
+		transaction.status = status;
+		if (transaction.handler != nullptr) {
+			transaction.handler(transaction.context);
+		}
+
+		// Continue with the next one (the handler may have queued it) after a STOP, as some slaves act on the STOP (e.g. an EEPROM starts writing)
+		Transaction * next = _head;
+		if (next == nullptr) {
+			return (1 << 4);
+		}
+		_load(*next);
+		return (1 << 4) | (1 << 5);
+	}
+
+	bool I2C::_isBusFree (void) {
+		return (GPIO::read(_pin_sda) == Pin::Level::high) && (GPIO::read(_pin_sda + 1) == Pin::Level::high);
+	}
+
+	void I2C::_delay (void) {
+		for (volatile uint32_t i = 0; i < _half_period; i++) {}
+	}
+
+	bool I2C::_recover (void) {
+		uint32_t pin_scl = _pin_sda + 1;
+		_recoveries++;
+
+		// Take the pins over as (open drain) GPIO, with both lines released
+		_lpc_i2c->I2CONCLR = (1 << 2) | (1 << 3) | (1 << 4) | (1 << 5) | (1 << 6);
+		GPIO::set(_pin_sda);
+		GPIO::set(pin_scl);
+		GPIO::setDirection(_pin_sda, Pin::Direction::output);
+		GPIO::setDirection(pin_scl, Pin::Direction::output);
+		GPIO::setFunction(_pin_sda, GPIO::Function::gpio);
+		GPIO::setFunction(pin_scl, GPIO::Function::gpio);
+
+		// Clock SCL (up to) 9 times, until the slave releases SDA at the end of the byte it is sending
+		for (uint32_t i = 0; (i < 9) && (GPIO::read(_pin_sda) == Pin::Level::low); i++) {
+			GPIO::clear(pin_scl);
+			_delay();
+			GPIO::set(pin_scl);
+			for (uint32_t timeout = 0; (timeout < 100) && (GPIO::read(pin_scl) == Pin::Level::low); timeout++) {
+				_delay();
+			}
+			_delay();
+		}
+
+		// Generate a STOP: SDA rises while SCL is high
+		GPIO::clear(pin_scl);
+		_delay();
+		GPIO::clear(_pin_sda);
+		_delay();
+		GPIO::set(pin_scl);
+		_delay();
+		GPIO::set(_pin_sda);
+		_delay();
+		bool free = _isBusFree();
+
+		// Give the pins back to the interface
+		GPIO::setFunction(_pin_sda, _function);
+		GPIO::setFunction(pin_scl, _function);
+		_lpc_i2c->I2CONSET = (1 << 6);
+		return free;
+	}
+
 	void I2C::handle (void) {
+		_handling = true;
 
 		// Read the state
 		switch (_lpc_i2c->I2STAT) {
@@ -127,10 +394,10 @@ namespace System {
 		case 0x10:
 
 			// (RE)START sent
-			if (tx_length != 0) {
-				_lpc_i2c->I2DAT = slave_address;
+			if (_segment->flags & Segment::read) {
+				_lpc_i2c->I2DAT = _slave_address | 1;
 			} else {
-				_lpc_i2c->I2DAT = slave_address | 1;
+				_lpc_i2c->I2DAT = _slave_address;
 			}
 			_lpc_i2c->I2CONCLR = (1 << 5);
 			_lpc_i2c->I2CONSET = (1 << 2);
@@ -139,31 +406,29 @@ namespace System {
 		case 0x18:
 		case 0x28:
 
-			// WRITE or data sent
-			if (tx_length != 0) {
-				_lpc_i2c->I2DAT = *tx_buffer;
-				tx_buffer++;
-				tx_length--;
+			// WRITE or data sent, continue with the next byte (possibly from the next segment)
+			while ((_length == 0) && _continueSegment()) {}
+			if (_length != 0) {
+				_lpc_i2c->I2DAT = *_buffer;
+				_buffer++;
+				_length--;
 				_lpc_i2c->I2CONSET = (1 << 2);
-			} else if (rx_length != 0) {
-				_lpc_i2c->I2CONSET = (1 << 2) | (1 << 5);
 			} else {
-				_lpc_i2c->I2CONSET = (1 << 2) | (1 << 4);
-				busy = false;
+				_lpc_i2c->I2CONSET = (1 << 2) | _nextSegment();
 			}
 			break;
 
 		case 0x50:
 
 			// Data received
-			*rx_buffer = _lpc_i2c->I2DAT;
-			rx_buffer++;
-			rx_length--;
+			*_buffer = _lpc_i2c->I2DAT;
+			_buffer++;
+			_length--;
 
 		case 0x40:
 
-			// READ sent
-			if (rx_length == 1) {
+			// READ sent, the last byte is not acknowledged
+			if (_length == 1) {
 				_lpc_i2c->I2CONCLR = (1 << 2);
 			} else {
 				_lpc_i2c->I2CONSET = (1 << 2);
@@ -172,33 +437,54 @@ namespace System {
 
 		case 0x58:
 
-			// Data received with No ACK
-			*rx_buffer = _lpc_i2c->I2DAT;
-			rx_buffer++;
-			rx_length--;
+			// Last data received (with No ACK), go on with the next segment
+			*_buffer = _lpc_i2c->I2DAT;
+			_buffer++;
+			_length--;
+			_lpc_i2c->I2CONSET = (1 << 2) | _nextSegment();
+			break;
 
 		case 0x20:
-		case 0x30:
 		case 0x48:
 
-			// No ACK received, send STOP
-			_lpc_i2c->I2CONSET = (1 << 2) | (1 << 4);
-			busy = false;
+			// Address not acknowledged, send STOP (and retry, or go on with the next transaction)
+			_nacks++;
+			_lpc_i2c->I2CONSET = (1 << 2) | _finish(Status::address_not_acknowledged);
+			break;
+
+		case 0x30:
+
+			// Data not acknowledged
+			_nacks++;
+			_lpc_i2c->I2CONSET = (1 << 2) | _finish(Status::data_not_acknowledged);
 			break;
 
 		case 0x38:
 
-			// Arbitration lost, resend START
+			// Arbitration lost, release the bus (a START is sent once the bus is free)
+			_arbitration_losses++;
 			_lpc_i2c->I2CONCLR = (1 << 2) | (1 << 5);
-			busy = false;
+			_lpc_i2c->I2CONSET = _finish(Status::arbitration_lost) & (1 << 5);
 			break;
 
+		case 0x00:
+
+			// Bus error, reset the interface and free the bus before going on
+			_bus_errors++;
+			_lpc_i2c->I2CONSET = (1 << 4);
+			_lpc_i2c->I2CONCLR = (1 << 3);
+			_recover();
+			_lpc_i2c->I2CONSET = _finish(Status::bus_error) & (1 << 5);
+			_handling = false;
+			return;
+
 		default:
 			break;
 		}
 
 		// Continue running the I2C interface
 		_lpc_i2c->I2CONCLR = (1 << 3);
+		_handling = false;
 	}
 
 	/************************************
@@ -14,14 +14,52 @@ MCP23017::MCP23017 (I2C & i2c, uint8_t slave_address) : I2CIOExtender(i2c, slave
 	_gppub = 0x00;
 	_gpioa = 0x00;
 	_gpiob = 0x00;
+
+	// One write per register, in the order of the shadow registers above
+	const uint8_t addresses[6] = {0x00, 0x01, 0x0C, 0x0D, 0x12, 0x13};
+	for (uint32_t i = 0; i < 6; i++) {
+		RegisterWrite & write = _writes[i];
+		write.i2c = &_i2c;
+		write.buffer[0] = addresses[i];
+		write.pending = false;
+		write.transaction = I2C::Transaction(_slave_address, write.buffer, 2, nullptr, 0);
+		write.transaction.handler = handleWrite;
+		write.transaction.context = &write;
+	}
 }
 
-void MCP23017::setDirection (uint32_t pin, Pin::Direction direction) {
+void MCP23017::handleWrite (void * context) {
+	RegisterWrite * write = (RegisterWrite *) context;
+
+	// The register changed while it was being written, so write it again
+	if (write->pending) {
+		write->pending = false;
+		write->buffer[1] = write->value;
+		write->i2c->submit(write->transaction);
+	}
+}
 
-	// Wait for the previous transfer to finish
-	while (_i2c.isBusy()) {}
+void MCP23017::_writeRegister (uint32_t index, uint8_t value) {
+	RegisterWrite & write = _writes[index];
 
-	// Use a buffer that will not go out of context
+	// A queued write just takes the new value, an active one is repeated when done
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	write.value = value;
+	if (write.transaction.status == I2C::Status::active) {
+		write.pending = true;
+	} else {
+		write.buffer[1] = value;
+		if (write.transaction.status != I2C::Status::queued) {
+			_i2c.submit(write.transaction);
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+void MCP23017::setDirection (uint32_t pin, Pin::Direction direction) {
+
+	// Update the shadow register, and queue the write
 	if (pin >> 5) {
 		pin = 1 << (pin & 0x7);
 		if (direction == Pin::Direction::input) {
@@ -29,8 +67,7 @@ void MCP23017::setDirection (uint32_t pin, Pin::Direction direction) {
 		} else {
 			_iodirb &= ~pin;
 		}
-		_tx_buffer[0] = 0x01;
-		_tx_buffer[1] = _iodirb;
+		_writeRegister(1, _iodirb);
 	} else {
 		pin = 1 << (pin & 0x7);
 		if (direction == Pin::Direction::input) {
@@ -38,20 +75,13 @@ void MCP23017::setDirection (uint32_t pin, Pin::Direction direction) {
 		} else {
 			_iodira &= ~pin;
 		}
-		_tx_buffer[0] = 0x00;
-		_tx_buffer[1] = _iodira;
+		_writeRegister(0, _iodira);
 	}
-
-	// Start transfer, but don't wait for it to finish!
-	_i2c.startTransfer(_slave_address, _tx_buffer, 2, nullptr, 0);
 }
 
 void MCP23017::setPullMode (uint32_t pin, Pin::PullMode mode) {
 
-	// Wait for the previous transfer to finish
-	while (_i2c.isBusy()) {}
-
-	// Use a buffer that will not go out of context
+	// Update the shadow register, and queue the write
 	if (pin >> 5) {
 		pin = 1 << (pin & 0x7);
 		if (mode == Pin::PullMode::pull_up) {
@@ -61,8 +91,7 @@ void MCP23017::setPullMode (uint32_t pin, Pin::PullMode mode) {
 			// Disable pull-up, as other modes not supported
 			_gppub &= ~pin;
 		}
-		_tx_buffer[0] = 0x0D;
-		_tx_buffer[1] = _gppub;
+		_writeRegister(3, _gppub);
 	} else {
 		pin = 1 << (pin & 0x7);
 		if (mode == Pin::PullMode::pull_up) {
@@ -72,12 +101,8 @@ void MCP23017::setPullMode (uint32_t pin, Pin::PullMode mode) {
 			// Disable pull-up, as other modes not supported
 			_gppua &= ~pin;
 		}
-		_tx_buffer[0] = 0x0C;
-		_tx_buffer[1] = _gppua;
+		_writeRegister(2, _gppua);
 	}
-
-	// Start transfer, but don't wait for it to finish!
-	_i2c.startTransfer(_slave_address, _tx_buffer, 2, nullptr, 0);
 }
 
 void MCP23017::setOpenDrain (uint32_t pin, bool open_drain) {
@@ -94,10 +119,7 @@ void MCP23017::clear (uint32_t pin) {
 
 void MCP23017::write (uint32_t pin, Pin::Level level) {
 
-	// Wait for the previous transfer to finish
-	while (_i2c.isBusy()) {}
-
-	// Use a buffer that will not go out of context
+	// Update the shadow register, and queue the write
 	if (pin >> 5) {
 		pin = 1 << (pin & 0x7);
 		if (level == Pin::Level::high) {
@@ -107,8 +129,7 @@ void MCP23017::write (uint32_t pin, Pin::Level level) {
 			// Disable pull-up, as other modes not supported
 			_gpiob &= ~pin;
 		}
-		_tx_buffer[0] = 0x13;
-		_tx_buffer[1] = _gpiob;
+		_writeRegister(5, _gpiob);
 	} else {
 		pin = 1 << (pin & 0x7);
 		if (level == Pin::Level::high) {
@@ -118,37 +139,45 @@ void MCP23017::write (uint32_t pin, Pin::Level level) {
 			// Disable pull-up, as other modes not supported
 			_gpioa &= ~pin;
 		}
-		_tx_buffer[0] = 0x12;
-		_tx_buffer[1] = _gpioa;
+		_writeRegister(4, _gpioa);
 	}
-
-	// Start transfer, but don't wait for it to finish!
-	_i2c.startTransfer(_slave_address, _tx_buffer, 2, nullptr, 0);
 }
 
 Pin::Level MCP23017::read (uint32_t pin) {
 
-	// Wait for the previous transfer to finish
-	while (_i2c.isBusy()) {}
+	// A failed read reads as low
+	Pin::Level level = Pin::Level::low;
+	read(pin, level);
+	return level;
+}
+
+bool MCP23017::read (uint32_t pin, Pin::Level & level) {
 
-	// Use a buffer that will not go out of context
+	// Queue the register read, behind the pending writes
+	uint8_t tx_buffer[1];
+	uint8_t rx_buffer[1] = {0};
 	if (pin >> 5) {
-		_tx_buffer[0] = 0x13;
+		tx_buffer[0] = 0x13;
 	} else {
-		_tx_buffer[0] = 0x12;
+		tx_buffer[0] = 0x12;
+	}
+	I2C::Transaction transaction(_slave_address, tx_buffer, 1, rx_buffer, 1);
+	if (!_i2c.submit(transaction)) {
+		return false;
 	}
 
-	// Start transfer
-	_i2c.startTransfer(_slave_address, _tx_buffer, 1, _tx_buffer + 1, 1);
-
-	// Wait for the transfer to finish
-	while (_i2c.isBusy()) {}
+	// Wait for the result
+	while (!transaction.isDone()) {}
+	if (transaction.status != I2C::Status::completed) {
+		return false;
+	}
 
 	// Read the result
 	pin = 1 << (pin & 0x7);
-	if (_tx_buffer[1] & pin) {
-		return Pin::Level::high;
+	if (rx_buffer[0] & pin) {
+		level = Pin::Level::high;
 	} else {
-		return Pin::Level::low;
+		level = Pin::Level::low;
 	}
+	return true;
 }
@@ -0,0 +1,116 @@
+// Includes
+#include <cstring>
+#include "LPC17xx.h"
+#include "memory_transfer.h"
+#include "dma.h"
+
+// Namespaces
+using namespace System;
+
+namespace System {
+
+	/************************************
+	* MemoryTransfer					*
+	************************************/
+
+	MemoryTransfer::MemoryTransfer (void) {
+		_dma = nullptr;
+		_busy = false;
+		_value = 0;
+	}
+
+	void MemoryTransfer::handleEvent (DMA::Event event, void * context) {
+		MemoryTransfer * transfer = (MemoryTransfer *) context;
+
+		// Done (or failed), return the channel to the pool
+		if ((event == DMA::Event::completed) || (event == DMA::Event::error)) {
+			transfer->_dma->detachHandler();
+			transfer->_dma->release();
+			transfer->_dma = nullptr;
+			transfer->_busy = false;
+		}
+	}
+
+	bool MemoryTransfer::start (void * destination, const void * source, uint32_t length, bool source_increment) {
+
+		// Small transfers are faster on the CPU, just like when DMA is not available
+		if ((length < MEMORY_TRANSFER_DMA_THRESHOLD) || !DMA::isEnabled()) {
+			return false;
+		}
+		_dma = DMA::allocate();
+		if (_dma == nullptr) {
+			return false;
+		}
+
+		// Use the widest transfer width allowed by the alignment, with bursts matching the 16-byte channel FIFO
+		uint32_t alignment = ((uint32_t) destination) | length;
+		if (source_increment) {
+			alignment |= (uint32_t) source;
+		}
+		DMA::TransferWidth width = DMA::TransferWidth::byte;
+		DMA::BurstSize burst = DMA::BurstSize::transfer_16;
+		uint32_t shift = 0;
+		if ((alignment & 0x03) == 0) {
+			width = DMA::TransferWidth::word;
+			burst = DMA::BurstSize::transfer_4;
+			shift = 2;
+		} else if ((alignment & 0x01) == 0) {
+			width = DMA::TransferWidth::halfword;
+			burst = DMA::BurstSize::transfer_8;
+			shift = 1;
+		}
+
+		// Start the transfer, the channel is released again on completion
+		_busy = true;
+		_dma->configure(DMA::TransferType::memory_to_memory,
+				DMA::Peripheral::unused, DMA::Peripheral::unused,
+				burst, burst, width, width,
+				source_increment, true);
+		_dma->attachHandler(handleEvent, this);
+		if (!_dma->transfer((volatile void *) source, destination, length >> shift)) {
+
+			// Too long for a single DMA chain
+			_dma->detachHandler();
+			_dma->release();
+			_dma = nullptr;
+			_busy = false;
+			return false;
+		}
+		return true;
+	}
+
+	bool MemoryTransfer::copy (void * destination, const void * source, uint32_t length) {
+
+		// Check if a new transfer can be started
+		if (isBusy())
+			return false;
+
+		// Fall back to the CPU
+		if (!start(destination, source, length, true)) {
+			memcpy(destination, source, length);
+		}
+		return true;
+	}
+
+	bool MemoryTransfer::fill (void * destination, uint8_t value, uint32_t length) {
+
+		// Check if a new transfer can be started
+		if (isBusy())
+			return false;
+
+		// The DMA reads the value (replicated for wider transfers) from this object
+		_value = (uint32_t) value * 0x01010101u;
+		if (!start(destination, &_value, length, false)) {
+			memset(destination, value, length);
+		}
+		return true;
+	}
+
+	bool MemoryTransfer::isBusy (void) {
+		return _busy;
+	}
+
+	void MemoryTransfer::wait (void) {
+		while (_busy) {}
+	}
+}
@@ -0,0 +1,471 @@
+// Includes
+#include <cstring>
+#include <cstddef>
+#include "record_store.h"
+#include "sst25lf020.h"
+
+// Namespaces
+using namespace System;
+
+namespace {
+	const uint32_t _magic = 0x474F4C52;		// "RLOG"
+	const uint32_t _marker = 0x4D4D5553;	// "SUMM"
+	const uint32_t _erased = 0xFFFFFFFF;
+	const uint32_t _sector_size = 4096;
+}
+
+RecordStore::RecordStore (SST25LF020 & flash, uint32_t first_sector, uint32_t number_of_sectors) : _flash(flash) {
+	_mounted = false;
+	_first_sector = first_sector;
+	_number_of_sectors = number_of_sectors;
+	for (uint32_t i = 0; i < _maximum_sectors; i++) {
+		_erase_counts[i] = 0;
+	}
+}
+
+/************************************
+* Helpers							*
+************************************/
+
+uint32_t RecordStore::_getSectorAddress (uint32_t sector) {
+	return (_first_sector + sector) * _sector_size;
+}
+
+uint32_t RecordStore::_getSector (uint32_t address) {
+	return (address / _sector_size) - _first_sector;
+}
+
+uint32_t RecordStore::_next (uint32_t sector) {
+	sector++;
+	return (sector == _number_of_sectors) ? 0 : sector;
+}
+
+bool RecordStore::_readFlash (uint32_t address, void * buffer, uint32_t length) {
+
+	// Reads wait for the flash (which also advances a program/erase)
+	while (_flash.isBusy()) {}
+	if (!_flash.read(address, (uint8_t *) buffer, length)) {
+		return false;
+	}
+	while (_flash.isBusy()) {}
+	return true;
+}
+
+void RecordStore::_copy (uint32_t address, uint8_t * buffer, uint32_t length) {
+
+	// Records that are not programmed yet are still in one of the buffers
+	for (uint32_t i = 0; i < 2; i++) {
+		Buffer & candidate = _buffers[i];
+		if ((candidate.length != 0) && (address >= candidate.address) && ((address + length) <= (candidate.address + candidate.length))) {
+			memcpy(buffer, &(candidate.data[address - candidate.address]), length);
+			return;
+		}
+	}
+	_readFlash(address, buffer, length);
+}
+
+uint8_t RecordStore::_checksum (uint8_t key, uint8_t length, const uint8_t * data) {
+	uint8_t sum = key + length;
+	for (uint32_t i = 0; i < length; i++) {
+		sum += data[i];
+	}
+
+	// Never the erased value, so a record is only complete once its checksum is programmed
+	sum = ~sum;
+	return (sum == 0xFF) ? 0xFE : sum;
+}
+
+bool RecordStore::_isErased (const void * data, uint32_t length) {
+	for (uint32_t i = 0; i < length; i++) {
+		if (((const uint8_t *) data)[i] != 0xFF) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void RecordStore::_resetSummary (Summary & summary) {
+	memset(&summary, 0xFF, sizeof(Summary));
+}
+
+/************************************
+* Mounting							*
+************************************/
+
+bool RecordStore::mount (void) {
+	if ((_number_of_sectors < 2) || (_number_of_sectors > _maximum_sectors) ||
+			((_getSectorAddress(_number_of_sectors) > SST25LF020::getSize()))) {
+		return false;
+	}
+
+	// Start empty
+	_mounted = false;
+	for (uint32_t key = 0; key < RECORD_STORE_MAXIMUM_KEYS; key++) {
+		_addresses[key] = _erased;
+		_lengths[key] = 0;
+	}
+	_buffers[0].length = 0;
+	_buffers[1].length = 0;
+	_fill = 0;
+	_programming = false;
+	_close_pending = false;
+	_open_pending = false;
+	_spare_erasing = false;
+	_active_closed = false;
+	_read_only = false;
+	_resetSummary(_summary);
+
+	// Find the active sector (the highest sequence number) from the headers
+	uint32_t sequences[_maximum_sectors];
+	_sequence = 0;
+	_active = _number_of_sectors - 1;
+	for (uint32_t i = 0; i < _number_of_sectors; i++) {
+		Header header;
+		_readFlash(_getSectorAddress(i), &header, sizeof(Header));
+		sequences[i] = _erased;
+		if ((header.magic != _magic) || (header.check != ~header.erase_count)) {
+			continue;
+		}
+		_erase_counts[i] = header.erase_count;
+		sequences[i] = header.sequence;
+		if ((header.sequence != _erased) && ((_sequence == 0) || ((int32_t) (header.sequence - _sequence) > 0))) {
+			_sequence = header.sequence;
+			_active = i;
+		}
+	}
+
+	// Replay the sectors from the oldest to the active one, from their summary when they were closed
+	_write_address = _getSectorAddress(_active) + _records_end;
+	for (uint32_t j = 1; (j <= _number_of_sectors) && (_sequence != 0); j++) {
+		uint32_t sector = (_active + j) % _number_of_sectors;
+		if (sequences[sector] == _erased) {
+			continue;
+		}
+		uint32_t base = _getSectorAddress(sector);
+		_readFlash(base + _records_end, &_closing_summary, sizeof(Summary));
+		if (_closing_summary.marker == _marker) {
+			_active_closed = (sector == _active);
+			for (uint32_t key = 0; key < RECORD_STORE_MAXIMUM_KEYS; key++) {
+				if (_closing_summary.offsets[key] != 0xFFFF) {
+					_addresses[key] = base + _closing_summary.offsets[key];
+					_lengths[key] = _closing_summary.lengths[key];
+				}
+			}
+		} else {
+
+			// A torn record cannot be programmed over, so the sector is full from there on
+			bool torn;
+			_resetSummary(_summary);
+			uint32_t end = _scan(sector, torn);
+			if ((sector == _active) && !torn) {
+				_write_address = end;
+			}
+
+			// Neither can a torn summary, the sector is then closed without one (and scanned when mounting)
+			if ((sector == _active) && !_isErased(&_closing_summary, sizeof(Summary))) {
+				_active_closed = true;
+				_write_address = base + _records_end;
+			}
+		}
+	}
+	_programmed_address = _write_address;
+
+	// The sector after the active one must be erased (and prepared) before it can be used
+	Header header;
+	_spare = _next(_active);
+	_readFlash(_getSectorAddress(_spare), &header, sizeof(Header));
+	if ((header.magic == _magic) && (header.check == ~header.erase_count) && (header.sequence == _erased)) {
+		_spare_ready = true;
+		_reserved = 0;
+	} else {
+
+		// The live records of the unfinished clean must fit in the active sector, which is not the case when a
+		// relocation was torn (the rest of the sector is lost). Then nothing can be written until it is formatted.
+		_startCleaning();
+		if ((_write_address + _reserved) > (_getSectorAddress(_active) + _records_end)) {
+			_read_only = true;
+		}
+	}
+
+	_mounted = true;
+	return true;
+}
+
+uint32_t RecordStore::_scan (uint32_t sector, bool & torn) {
+	uint32_t base = _getSectorAddress(sector);
+	uint32_t address = base + _records_start;
+	torn = false;
+
+	// Follow the records up to erased memory
+	while ((address + _record_size) <= (base + _records_end)) {
+		uint8_t header[_record_header_size];
+		uint8_t data[RECORD_STORE_MAXIMUM_RECORD_SIZE + 1];
+		_readFlash(address, header, _record_header_size);
+		uint8_t key = header[0];
+		uint8_t length = header[1];
+		if (key == 0xFF) {
+			break;
+		}
+		if ((key >= RECORD_STORE_MAXIMUM_KEYS) || (length > RECORD_STORE_MAXIMUM_RECORD_SIZE) ||
+				((address + _record_size + length) > (base + _records_end))) {
+			torn = true;
+			break;
+		}
+		_readFlash(address + _record_header_size, data, length + 1);
+		if (_checksum(key, length, data) != data[length]) {
+			torn = true;
+			break;
+		}
+		_addresses[key] = address;
+		_lengths[key] = length;
+		_summary.offsets[key] = address - base;
+		_summary.lengths[key] = length;
+		address += _record_size + length;
+	}
+	return address;
+}
+
+bool RecordStore::format (void) {
+	if ((_number_of_sectors < 2) || (_number_of_sectors > _maximum_sectors) ||
+			((_getSectorAddress(_number_of_sectors) > SST25LF020::getSize()))) {
+		return false;
+	}
+
+	// Erase and prepare all sectors (blocking, anything not written yet is lost)
+	_mounted = false;
+	for (uint32_t i = 0; i < _number_of_sectors; i++) {
+		while (_flash.isBusy()) {}
+		if (!_flash.eraseSector(_getSectorAddress(i))) {
+			return false;
+		}
+		while (_flash.isBusy()) {}
+		_erase_counts[i]++;
+		_header.magic = _magic;
+		_header.sequence = _erased;
+		_header.erase_count = _erase_counts[i];
+		_header.check = ~_header.erase_count;
+		_flash.program(_getSectorAddress(i), (const uint8_t *) &_header, sizeof(Header));
+	}
+	return mount();
+}
+
+/************************************
+* Records							*
+************************************/
+
+bool RecordStore::write (uint8_t key, const void * data, uint8_t length) {
+	if (!_mounted || _read_only || (key >= RECORD_STORE_MAXIMUM_KEYS) || (length > RECORD_STORE_MAXIMUM_RECORD_SIZE)) {
+		return false;
+	}
+
+	// Keep room to copy the live records of the sector being cleaned, a record that is replaced no longer needs it
+	uint32_t size = _record_size + length;
+	uint32_t end = _getSectorAddress(_active) + _records_end;
+	if ((_write_address + size + _reserved) > end) {
+		if (!_switchSector()) {
+			return false;
+		}
+		end = _getSectorAddress(_active) + _records_end;
+		if ((_write_address + size + _reserved) > end) {
+			return false;
+		}
+	}
+	bool relocated = !_spare_ready && (_addresses[key] != _erased) && (_getSector(_addresses[key]) == _spare);
+	uint8_t replaced_length = _lengths[key];
+	if (!_append(key, (const uint8_t *) data, length)) {
+		return false;
+	}
+	if (relocated) {
+		_reserved -= _record_size + replaced_length;
+	}
+	return true;
+}
+
+uint8_t RecordStore::read (uint8_t key, void * data, uint8_t size) {
+	if (!_mounted || (key >= RECORD_STORE_MAXIMUM_KEYS) || (_addresses[key] == _erased)) {
+		return 0;
+	}
+	uint8_t length = (_lengths[key] < size) ? _lengths[key] : size;
+	_copy(_addresses[key] + _record_header_size, (uint8_t *) data, length);
+	return length;
+}
+
+bool RecordStore::_append (uint8_t key, const uint8_t * data, uint8_t length) {
+
+	// The fill buffer holds a contiguous part of the active sector, and never reaches into its summary
+	Buffer & buffer = _buffers[_fill];
+	uint32_t size = _record_size + length;
+	if (((buffer.length + size) > RECORD_STORE_BUFFER_SIZE) || ((_write_address + size) > (_getSectorAddress(_active) + _records_end))) {
+		return false;
+	}
+	if (buffer.length == 0) {
+		buffer.address = _write_address;
+	}
+	uint8_t * record = &(buffer.data[buffer.length]);
+	record[0] = key;
+	record[1] = length;
+	memcpy(&(record[_record_header_size]), data, length);
+	record[_record_header_size + length] = _checksum(key, length, data);
+	buffer.length += size;
+
+	// Update the index right away, reads are served from the buffer until it is programmed
+	_addresses[key] = _write_address;
+	_lengths[key] = length;
+	_summary.offsets[key] = _write_address - _getSectorAddress(_active);
+	_summary.lengths[key] = length;
+	_write_address += size;
+	return true;
+}
+
+bool RecordStore::_switchSector (void) {
+	if (!_spare_ready || _close_pending || _open_pending) {
+		return false;
+	}
+
+	// The records of the full sector must be handed over for programming first
+	if (_buffers[_fill].length != 0) {
+		if (_buffers[_fill ^ 1].length != 0) {
+			return false;
+		}
+		_fill ^= 1;
+	}
+
+	// Close the full sector with its summary (unless the store was empty, or it was closed before mounting)
+	if ((_sequence != 0) && !_active_closed) {
+		_closing_sector = _active;
+		_closing_summary = _summary;
+		_closing_summary.marker = _marker;
+		_close_pending = true;
+	}
+
+	// Open the prepared sector by giving it the next sequence number
+	_active = _spare;
+	_active_closed = false;
+	_sequence++;
+	_open_sequence = _sequence;
+	_open_pending = true;
+	_write_address = _getSectorAddress(_active) + _records_start;
+	_programmed_address = _write_address;
+	_resetSummary(_summary);
+
+	// And start cleaning the next one
+	_spare = _next(_active);
+	_startCleaning();
+	return true;
+}
+
+void RecordStore::_startCleaning (void) {
+	_spare_ready = false;
+	_relocate_key = 0;
+	_relocate_end = 0;
+
+	// Reserve room for the live records in the sector to clean
+	_reserved = 0;
+	for (uint32_t key = 0; key < RECORD_STORE_MAXIMUM_KEYS; key++) {
+		if ((_addresses[key] != _erased) && (_getSector(_addresses[key]) == _spare)) {
+			_reserved += _record_size + _lengths[key];
+		}
+	}
+}
+
+/************************************
+* Background processing				*
+************************************/
+
+void RecordStore::process (void) {
+
+	// One flash operation at a time, checking the flash also advances a program
+	if (!_mounted || _flash.isBusy()) {
+		return;
+	}
+
+	// The previous program is done
+	if (_programming) {
+		Buffer & buffer = _buffers[_fill ^ 1];
+		if (_getSector(buffer.address) == _active) {
+			_programmed_address = buffer.address + buffer.length;
+		}
+		buffer.length = 0;
+		_programming = false;
+	}
+
+	// Prepare an erased sector, keeping its erase count
+	if (_spare_erasing) {
+		_header.magic = _magic;
+		_header.sequence = _erased;
+		_header.erase_count = _erase_counts[_spare];
+		_header.check = ~_header.erase_count;
+		_flash.program(_getSectorAddress(_spare), (const uint8_t *) &_header, sizeof(Header));
+		_spare_erasing = false;
+		_spare_ready = true;
+		return;
+	}
+
+	// Records handed over by a sector switch, then the summary of the full sector, then the header of the new one
+	Buffer & pending = _buffers[_fill ^ 1];
+	if (pending.length != 0) {
+		_flash.program(pending.address, pending.data, pending.length);
+		_programming = true;
+		return;
+	}
+	if (_close_pending) {
+		_flash.program(_getSectorAddress(_closing_sector) + _records_end, (const uint8_t *) &_closing_summary, sizeof(Summary));
+		_close_pending = false;
+		return;
+	}
+	if (_open_pending) {
+		_flash.program(_getSectorAddress(_active) + offsetof(Header, sequence), (const uint8_t *) &_open_sequence, sizeof(uint32_t));
+		_open_pending = false;
+		return;
+	}
+
+	// Program the buffered records in a single AAI burst, while the other buffer fills
+	if (_buffers[_fill].length != 0) {
+		_fill ^= 1;
+		_flash.program(_buffers[_fill ^ 1].address, _buffers[_fill ^ 1].data, _buffers[_fill ^ 1].length);
+		_programming = true;
+		return;
+	}
+
+	// Clean the next sector: copy its live records forward, and erase it once the copies are programmed
+	if (!_spare_ready && !_read_only) {
+		for (; _relocate_key < RECORD_STORE_MAXIMUM_KEYS; _relocate_key++) {
+			uint32_t key = _relocate_key;
+			if ((_addresses[key] == _erased) || (_getSector(_addresses[key]) != _spare)) {
+				continue;
+			}
+			uint8_t data[RECORD_STORE_MAXIMUM_RECORD_SIZE];
+			uint8_t length = _lengths[key];
+			_readFlash(_addresses[key] + _record_header_size, data, length);
+			if (!_append(key, data, length)) {
+				return;
+			}
+			_reserved -= _record_size + length;
+			_relocate_end = _write_address;
+		}
+		if (_programmed_address >= _relocate_end) {
+			_erase_counts[_spare]++;
+			_flash.eraseSector(_getSectorAddress(_spare));
+			_spare_erasing = true;
+		}
+	}
+}
+
+bool RecordStore::isIdle (void) {
+	return _mounted && !_programming && (_buffers[0].length == 0) && (_buffers[1].length == 0) &&
+			!_close_pending && !_open_pending && (_spare_ready || _read_only) && !_spare_erasing && !_flash.isBusy();
+}
+
+bool RecordStore::isWritable (void) {
+	return _mounted && !_read_only;
+}
+
+uint32_t RecordStore::getMaximumEraseCount (void) {
+	uint32_t maximum = 0;
+	for (uint32_t i = 0; i < _number_of_sectors; i++) {
+		if (_erase_counts[i] > maximum) {
+			maximum = _erase_counts[i];
+		}
+	}
+	return maximum;
+}
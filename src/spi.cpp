@@ -16,6 +16,10 @@ using namespace System;
 
 namespace {
 	void (*handleInterruptPointer[3]) (void) = {nullptr, nullptr, nullptr};
+
+	// Source for receive-only transfers, and destination to discard received frames (DMA and ISR)
+	const uint32_t _dma_dummy_tx = 0;
+	uint32_t _dma_dummy_rx;
 }
 
 extern "C" {
@@ -43,46 +47,80 @@ extern "C" {
 * SPI Base Implementation			*
 ************************************/
 
-SPI::SPI (volatile uint32_t * data_register) {
+SPI::SPI (volatile uint32_t * data_register, const volatile uint32_t * status_register, uint32_t receive_flag, IRQn_Type interrupt, uint8_t fifo_depth) {
+	_fifo_depth = fifo_depth;
+	_polling_threshold = SPI_POLLING_THRESHOLD;
 	_busy = false;
 	_tx_buffer = nullptr;
 	_rx_buffer = nullptr;
+	_next = &SPI::_nextFrame<uint8_t>;
+	_handler = nullptr;
+	_handler_context = nullptr;
 
 	// Cache the address to make the ISR faster
-	// Alternative 1 would be to call getDataRegister() every time in _write() and _read()
-	// Alternative 2 would be to implement the _write() and _read() in the derived classes
+	// Alternative 1 would be to call getDataRegister() every time in _write<>() and _read<>()
+	// Alternative 2 would be to implement the _write<>() and _read<>() in the derived classes
 	_data_register = data_register;
+
+	// Everything needed to poll a transfer without knowing the peripheral
+	_status_register = status_register;
+	_receive_flag = receive_flag;
+	_interrupt = interrupt;
 }
 
 bool SPI::isBusy (void) {
 	return _busy;
 }
 
-bool SPI::transmit (uint8_t * tx_buffer, uint16_t length) {
-	return _transceive (tx_buffer, nullptr, length, true);
+void SPI::setPollingThreshold (uint16_t length) {
+	_polling_threshold = length;
+}
+
+uint16_t SPI::getPollingThreshold (void) {
+	return _polling_threshold;
 }
 
-bool SPI::receive (uint8_t * rx_buffer, uint16_t length) {
-	return _transceive (nullptr, rx_buffer, length, true);
+void SPI::attachHandler (void (*handler)(void * context), void * context) {
+	_handler = nullptr;
+	_handler_context = context;
+	_handler = handler;
 }
 
-bool SPI::transceive (uint8_t * tx_buffer, uint8_t * rx_buffer, uint16_t length) {
-	return _transceive (tx_buffer, rx_buffer, length, true);
+void SPI::detachHandler (void) {
+	_handler = nullptr;
 }
 
-bool SPI::transmit (uint16_t * tx_buffer, uint16_t length) {
-	return _transceive (tx_buffer, nullptr, length, false);
+void SPI::getHandler (void (*&handler)(void * context), void *& context) {
+	handler = _handler;
+	context = _handler_context;
 }
 
-bool SPI::receive (uint16_t * rx_buffer, uint16_t length) {
-	return _transceive (nullptr, rx_buffer, length, false);
+bool SPI::transmit (uint8_t * tx_buffer, uint16_t length, TransferMode transfer_mode) {
+	return _transceive<uint8_t> (tx_buffer, nullptr, length, transfer_mode);
 }
 
-bool SPI::transceive (uint16_t * tx_buffer, uint16_t * rx_buffer, uint16_t length) {
-	return _transceive (tx_buffer, rx_buffer, length, false);
+bool SPI::receive (uint8_t * rx_buffer, uint16_t length, TransferMode transfer_mode) {
+	return _transceive<uint8_t> (nullptr, rx_buffer, length, transfer_mode);
 }
 
-bool SPI::_transceive (void * tx_buffer, void * rx_buffer, uint16_t length, bool byte) {
+bool SPI::transceive (uint8_t * tx_buffer, uint8_t * rx_buffer, uint16_t length, TransferMode transfer_mode) {
+	return _transceive<uint8_t> (tx_buffer, rx_buffer, length, transfer_mode);
+}
+
+bool SPI::transmit (uint16_t * tx_buffer, uint16_t length, TransferMode transfer_mode) {
+	return _transceive<uint16_t> (tx_buffer, nullptr, length, transfer_mode);
+}
+
+bool SPI::receive (uint16_t * rx_buffer, uint16_t length, TransferMode transfer_mode) {
+	return _transceive<uint16_t> (nullptr, rx_buffer, length, transfer_mode);
+}
+
+bool SPI::transceive (uint16_t * tx_buffer, uint16_t * rx_buffer, uint16_t length, TransferMode transfer_mode) {
+	return _transceive<uint16_t> (tx_buffer, rx_buffer, length, transfer_mode);
+}
+
+template<typename T>
+bool SPI::_transceive (const T * tx_buffer, T * rx_buffer, uint16_t length, TransferMode transfer_mode) {
 
 	// Check if a new transfer can be started
 	if (isBusy())
@@ -90,68 +128,117 @@ bool SPI::_transceive (void * tx_buffer, void * rx_buffer, uint16_t length, bool
 	if (length == 0)
 		return true;
 
-	// Store all settings
-	_byte = byte;
-	_tx_buffer = tx_buffer;
-	_rx_buffer = rx_buffer;
+	// Store all settings, a missing buffer is replaced by a dummy that is not advanced
+	_tx_buffer = (tx_buffer != nullptr) ? (const void *) tx_buffer : (const void *) &_dma_dummy_tx;
+	_tx_step = (tx_buffer != nullptr) ? 1 : 0;
+	_rx_buffer = (rx_buffer != nullptr) ? (void *) rx_buffer : (void *) &_dma_dummy_rx;
+	_rx_step = (rx_buffer != nullptr) ? 1 : 0;
 	_length = length;
+	_tx_length = length;
+
+	// The frame width is resolved once here, so the ISR only moves data
+	_next = &SPI::_nextFrame<T>;
 
-	// Start the transfer by writing the first byte, the rest is handled in the ISR
+	// Short transfers are done faster than the interrupts can be taken, so poll them
+	if (transfer_mode == TransferMode::automatic) {
+		transfer_mode = (length <= _polling_threshold) ? TransferMode::polled : TransferMode::interrupt_driven;
+	}
+	if (transfer_mode == TransferMode::polled) {
+
+		// Keep the ISR out, it would compete for the received frames
+		Interrupt::disable(_interrupt);
+		_busy = true;
+		_fill<T>();
+		_poll(length);
+		return true;
+	}
+
+	// Start the transfer by filling the TX FIFO, the rest is handled in the ISR (kept out while filling)
 	_busy = true; // FIXME: place before, also in other peripherals!
-	_write();
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	_fill<T>();
+	__set_PRIMASK(primask);
 
 	// The transfer was successfully started
 	return true;
 }
 
-void SPI::_write (void) {
+void SPI::_poll (uint16_t length) {
+
+	// Send the next frame for every frame received
+	for (; length != 0; length--) {
+		while ((*_status_register & _receive_flag) == 0);
 
-	// Write a single byte
-	if (_tx_buffer != nullptr) {
-		if (_byte) {
-			*_data_register = *((uint8_t *)_tx_buffer);
-			_tx_buffer = ((uint8_t *)_tx_buffer) + 1;
-		} else {
-			*_data_register = *((uint16_t *)_tx_buffer);
-			_tx_buffer = ((uint16_t *)_tx_buffer) + 1;
+		// Anything pending before the last frame is a left-over from the polled frames. It is cleared before
+		// the completion handler runs, as the handler may start another transfer whose interrupts must be kept.
+		if (length == 1) {
+			Interrupt::clearPending(_interrupt);
 		}
-	} else {
-		// Dummy write
-		*_data_register = 0;
+		next();
 	}
+	Interrupt::enable(_interrupt);
 }
 
-void SPI::_read (void) {
+template<typename T>
+void SPI::_fill (void) {
 
-	// Read a single byte
-	if (_rx_buffer != nullptr) {
-		if (_byte) {
-			*((uint8_t *)_rx_buffer) = *_data_register;
-			_rx_buffer = ((uint8_t *)_rx_buffer) + 1;
-		} else {
-			*((uint16_t *)_rx_buffer) = *_data_register;
-			_rx_buffer = ((uint16_t *)_rx_buffer) + 1;
-		}
-	} else {
-		// Dummy read
-		volatile uint32_t data = *_data_register;
+	// Fill the TX FIFO
+	for (uint32_t i = 0; (i < _fifo_depth) && (_tx_length != 0); i++) {
+		_write<T>();
+		_tx_length--;
 	}
 }
 
-void SPI::next (void) {
+template<typename T>
+void SPI::_write (void) {
+
+	// Write a single frame (the dummy source is not advanced)
+	const T * tx_buffer = (const T *) _tx_buffer;
+	*_data_register = *tx_buffer;
+	_tx_buffer = tx_buffer + _tx_step;
+}
 
-	// Read and store the received byte
-	_read();
+template<typename T>
+void SPI::_read (void) {
+
+	// Read a single frame (the dummy destination is not advanced)
+	T * rx_buffer = (T *) _rx_buffer;
+	*rx_buffer = *_data_register;
+	_rx_buffer = rx_buffer + _rx_step;
+}
+
+template<typename T>
+void SPI::_nextFrame (void) {
+
+	// Read and store the received frame
+	_read<T>();
 
 	// Decrement the transfer count, and terminate if this was the last
 	_length--;
 	if (_length == 0) {
-		_busy = false;
+		complete();
 		return;
 	}
 
-	// Send the next byte
-	_write();
+	// Send the next frame (if any), keeping the number of frames in flight within the FIFO depth
+	if (_tx_length != 0) {
+		_write<T>();
+		_tx_length--;
+	}
+}
+
+void SPI::next (void) {
+	(this->*_next)();
+}
+
+void SPI::complete (void) {
+
+	// Release the peripheral first, so the handler can start the next transfer
+	_busy = false;
+	if (_handler != nullptr) {
+		_handler(_handler_context);
+	}
 }
 
 /************************************
@@ -162,23 +249,37 @@ volatile uint32_t * LegacySPI::getDataRegister (void) {
 	return &(LPC_SPI->SPDR);
 }
 
-LegacySPI::LegacySPI (void) : SPI(getDataRegister()) {
-
+LegacySPI::LegacySPI (void) : SPI(getDataRegister(), &(LPC_SPI->SPSR), (1 << 7), SPI_IRQn, 1) {
+	_peripheral_frequency = 0;
 }
 
-void LegacySPI::initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode) {
+uint32_t LegacySPI::initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode) {
 
-	// Calculate the clock divider
-	uint32_t divider = peripheral_frequency / spi_clock_frequency;
+	// Calculate the clock divider, which must be even and at least 8 (rounded up to stay at or below the requested clock)
+	uint32_t divider = (spi_clock_frequency == 0) ? 254 : ((peripheral_frequency + spi_clock_frequency - 1) / spi_clock_frequency);
+	divider = (divider + 1) & ~1;
 	if (divider < 8) {
 		divider = 8;
-	} else if (divider > 255) {
-		divider = 255;
+	} else if (divider > 254) {
+		divider = 254;
 	}
 
 	// Setup all registers
+	_peripheral_frequency = peripheral_frequency;
 	LPC_SPI->SPCCR = divider;
 	LPC_SPI->SPCR = mode;
+
+	// Return the actual clock frequency
+	return peripheral_frequency / divider;
+}
+
+bool LegacySPI::configure (uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first) {
+	uint32_t mode = LegacySPI::mode(bits, clock_phase_2nd_edge, clock_polarity_active_low, lsb_first);
+	if (isBusy() || (mode == 0) || (_peripheral_frequency == 0)) {
+		return false;
+	}
+	initialize(_peripheral_frequency, spi_clock_frequency, mode);
+	return true;
 }
 
 uint32_t LegacySPI::mode (uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first) {
@@ -203,13 +304,13 @@ void LegacySPI::handle (void) {
 		// Read the SPI status register
 		uint32_t status = LPC_SPI->SPSR;
 
+		// Clear the interrupt flag first, next() may already start the next frame (or transfer)
+		LPC_SPI->SPINT = (1 << 0);
+
 		// SPI transfer complete?
 		if (status & (1 << 7)) {
 			next();
 		}
-
-		// Clear the interrupt flag
-		LPC_SPI->SPINT = (1 << 0);
 	}
 }
 
@@ -217,39 +318,55 @@ void LegacySPI::handle (void) {
 * SSP								*
 ************************************/
 
-volatile uint32_t * SSP::getDataRegister (uint32_t instance) {
+LPC_SSP_TypeDef * SSP::getRegisters (uint32_t instance) {
 	if (instance == 0) {
-		return &(LPC_SSP0->DR);
+		return LPC_SSP0;
 	} else { // (instance == 1)
-		return &(LPC_SSP1->DR);
+		return LPC_SSP1;
 	}
 }
 
-SSP::SSP (uint32_t instance) : SPI(getDataRegister(instance)) {
+SSP::SSP (uint32_t instance) : SPI(&(getRegisters(instance)->DR), &(getRegisters(instance)->SR), (1 << 2), (instance == 0) ? SSP0_IRQn : SSP1_IRQn, 8) {
 	if (instance == 0) {
 		_lpc_ssp = LPC_SSP0;
+		_tx_peripheral = DMA::Peripheral::ssp0_tx;
+		_rx_peripheral = DMA::Peripheral::ssp0_rx;
 	} else { // (instance == 1)
 		_lpc_ssp = LPC_SSP1;
+		_tx_peripheral = DMA::Peripheral::ssp1_tx;
+		_rx_peripheral = DMA::Peripheral::ssp1_rx;
 	}
+	_tx_dma = nullptr;
+	_rx_dma = nullptr;
+	_peripheral_frequency = 0;
 }
 
-void SSP::initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode) {
+uint32_t SSP::initialize (uint32_t peripheral_frequency, uint32_t spi_clock_frequency, uint32_t mode) {
 
-	// Calculate the clock divider
-	uint32_t divider = peripheral_frequency / spi_clock_frequency / 2;
-	if (divider < 6) {
-		divider = 6;
-	} else if (divider > 65536) {
-		divider = 65536;
-	}
-	divider = divider - 1;
+	// Calculate the prescaler and the serial clock rate
+	ClockConfiguration clock = calculateClock(peripheral_frequency, spi_clock_frequency);
 
-	// Setup all registers
-	_lpc_ssp->CPSR = 2;
-	_lpc_ssp->IMSC = (1 << 1);
-	_lpc_ssp->CR0 = mode | (divider << 8);
+	// Setup all registers (with the SSP disabled)
+	_peripheral_frequency = peripheral_frequency;
+	_lpc_ssp->CR1 = 0;
+	_lpc_ssp->CPSR = clock.prescaler;
+	_lpc_ssp->IMSC = (1 << 1) | (1 << 2);
+	_lpc_ssp->CR0 = mode | (clock.scr << 8);
 	_lpc_ssp->CR1 = (1 << 1);
 
+	// Return the actual clock frequency
+	return clock.frequency;
+}
+
+bool SSP::configure (uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first) {
+
+	// The SSP always sends the MSB first
+	uint32_t mode = SSP::mode(bits, clock_phase_2nd_edge, clock_polarity_active_low);
+	if (isBusy() || (mode == 0) || lsb_first || (_peripheral_frequency == 0)) {
+		return false;
+	}
+	initialize(_peripheral_frequency, spi_clock_frequency, mode);
+	return true;
 }
 
 uint32_t SSP::mode (uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low) {
@@ -268,21 +385,127 @@ uint32_t SSP::mode (uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarit
 
 void SSP::handle (void) {
 
-	if (_lpc_ssp->MIS & (1 << 1)) {
+	// RX FIFO half full or RX time-out
+	if (_lpc_ssp->MIS & ((1 << 1) | (1 << 2))) {
 
-		// Read the SPI status register
-		uint32_t status = _lpc_ssp->SR;
-
-		// SPI transfer complete?
-		if (status & (1 << 2)) {
+		// Read all received frames, each one makes room for the next frame to send
+		while (isBusy() && (_lpc_ssp->SR & (1 << 2))) {
 			next();
 		}
 
-		// Clear the interrupt flag
+		// Clear the time-out interrupt flag (the half full flag clears itself)
 		_lpc_ssp->ICR = (1 << 1);
 	}
 }
 
+bool SSP::transmit (uint8_t * tx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma) {
+	return _transceive(tx_buffer, nullptr, length, true, tx_dma, rx_dma);
+}
+
+bool SSP::receive (uint8_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma) {
+	return _transceive(nullptr, rx_buffer, length, true, tx_dma, rx_dma);
+}
+
+bool SSP::transceive (uint8_t * tx_buffer, uint8_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma) {
+	return _transceive(tx_buffer, rx_buffer, length, true, tx_dma, rx_dma);
+}
+
+bool SSP::transmit (uint16_t * tx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma) {
+	return _transceive(tx_buffer, nullptr, length, false, tx_dma, rx_dma);
+}
+
+bool SSP::receive (uint16_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma) {
+	return _transceive(nullptr, rx_buffer, length, false, tx_dma, rx_dma);
+}
+
+bool SSP::transceive (uint16_t * tx_buffer, uint16_t * rx_buffer, uint32_t length, DMA & tx_dma, DMA & rx_dma) {
+	return _transceive(tx_buffer, rx_buffer, length, false, tx_dma, rx_dma);
+}
+
+bool SSP::_transceive (void * tx_buffer, void * rx_buffer, uint32_t length, bool byte, DMA & tx_dma, DMA & rx_dma) {
+
+	// Check if a new transfer can be started
+	if (isBusy())
+		return false;
+	if (length == 0)
+		return true;
+
+	// The DMA takes over, so disable the interrupts
+	_busy = true;
+	_lpc_ssp->IMSC = 0;
+	_tx_dma = &tx_dma;
+	_rx_dma = &rx_dma;
+
+	// Without a buffer, a dummy source/destination is used that is not incremented
+	DMA::TransferWidth width = byte ? DMA::TransferWidth::byte : DMA::TransferWidth::halfword;
+	rx_dma.configure(
+			DMA::TransferType::peripheral_to_memory,
+			_rx_peripheral, DMA::Peripheral::unused,
+			DMA::BurstSize::transfer_4, DMA::BurstSize::transfer_4,
+			width, width,
+			false, (rx_buffer != nullptr));
+	tx_dma.configure(
+			DMA::TransferType::memory_to_peripheral,
+			DMA::Peripheral::unused, _tx_peripheral,
+			DMA::BurstSize::transfer_4, DMA::BurstSize::transfer_4,
+			width, width,
+			(tx_buffer != nullptr), false);
+
+	// The transfer is done once the last frame is received, the transmit side only reports errors
+	rx_dma.attachHandler(handleDMAEvent, this);
+	tx_dma.attachHandler(handleTXDMAEvent, this);
+	if (!rx_dma.transfer(&(_lpc_ssp->DR), (rx_buffer != nullptr) ? rx_buffer : &_dma_dummy_rx, length) ||
+			!tx_dma.transfer((tx_buffer != nullptr) ? tx_buffer : (void *) &_dma_dummy_tx, &(_lpc_ssp->DR), length)) {
+
+		// Too long for a single DMA chain (both have the same length, so neither was started)
+		rx_dma.detachHandler();
+		tx_dma.detachHandler();
+		_lpc_ssp->IMSC = (1 << 1) | (1 << 2);
+		_busy = false;
+		return false;
+	}
+
+	// Start by enabling the DMA requests
+	_lpc_ssp->DMACR = (1 << 1) | (1 << 0);
+	return true;
+}
+
+void SSP::handleDMAEvent (DMA::Event event, void * context) {
+	SSP * ssp = (SSP *) context;
+
+	// Done (or failed), return to interrupt driven transfers
+	if ((event == DMA::Event::completed) || (event == DMA::Event::error)) {
+		ssp->_finishDMA(event == DMA::Event::error);
+	}
+}
+
+void SSP::handleTXDMAEvent (DMA::Event event, void * context) {
+	SSP * ssp = (SSP *) context;
+
+	// Without frames being sent, the receive channel would never complete
+	if (event == DMA::Event::error) {
+		ssp->_finishDMA(true);
+	}
+}
+
+void SSP::_finishDMA (bool error) {
+
+	// Make sure both channels are stopped, and no frames of a failed transfer are left behind
+	_lpc_ssp->DMACR = 0;
+	_tx_dma->detachHandler();
+	_rx_dma->detachHandler();
+	if (error) {
+		_tx_dma->abort();
+		_rx_dma->abort();
+		while (_lpc_ssp->SR & (1 << 4)) {}
+		while (_lpc_ssp->SR & (1 << 2)) {
+			(void) _lpc_ssp->DR;
+		}
+	}
+	_lpc_ssp->IMSC = (1 << 1) | (1 << 2);
+	complete();
+}
+
 /************************************
 * SPI0 Singleton					*
 ************************************/
@@ -300,7 +523,7 @@ void SPI0::handleInterrupt (void) {
 	instance().handle();
 }
 
-void SPI0::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first) {
+uint32_t SPI0::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first) {
 	Clock::enablePeripheral(Clock::PeripheralPower::spi_power);
 	Clock::setPeripheralClock(Clock::PeripheralClock::spi_clock, clock);
 	uint32_t frequency = Clock::getPeripheralClockFrequency(Clock::PeripheralClock::spi_clock);
@@ -326,8 +549,9 @@ void SPI0::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_fre
 	pin_mosi.setOpenDrain(false);
 
 	uint32_t mode = LegacySPI::mode(bits, clock_phase_2nd_edge, clock_polarity_active_low, lsb_first);
-	LegacySPI::initialize(frequency, spi_clock_frequency, mode);
+	uint32_t spi_frequency = LegacySPI::initialize(frequency, spi_clock_frequency, mode);
 	System::Interrupt::enable(SPI_IRQn);
+	return spi_frequency;
 }
 
 /************************************
@@ -347,7 +571,7 @@ void SSP0::handleInterrupt (void) {
 	instance().handle();
 }
 
-void SSP0::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low) {
+uint32_t SSP0::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low) {
 	Clock::enablePeripheral(Clock::PeripheralPower::ssp_0_power);
 	Clock::setPeripheralClock(Clock::PeripheralClock::ssp_0_clock, clock);
 	uint32_t frequency = Clock::getPeripheralClockFrequency(Clock::PeripheralClock::ssp_0_clock);
@@ -355,8 +579,9 @@ void SSP0::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_fre
 	// FIXME: implement pin initialization!
 
 	uint32_t mode = SSP::mode(bits, clock_phase_2nd_edge, clock_polarity_active_low);
-	SSP::initialize(frequency, spi_clock_frequency, mode);
+	uint32_t spi_frequency = SSP::initialize(frequency, spi_clock_frequency, mode);
 	System::Interrupt::enable(SSP0_IRQn);
+	return spi_frequency;
 }
 
 /************************************
@@ -376,7 +601,7 @@ void SSP1::handleInterrupt (void) {
 	instance().handle();
 }
 
-void SSP1::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low) {
+uint32_t SSP1::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low) {
 	Clock::enablePeripheral(Clock::PeripheralPower::ssp_1_power);
 	Clock::setPeripheralClock(Clock::PeripheralClock::ssp_1_clock, clock);
 	uint32_t frequency = Clock::getPeripheralClockFrequency(Clock::PeripheralClock::ssp_1_clock);
@@ -384,6 +609,7 @@ void SSP1::initialize (Clock::PeripheralClockSpeed clock, uint32_t spi_clock_fre
 	// FIXME: implement pin initialization!
 
 	uint32_t mode = SSP::mode(bits, clock_phase_2nd_edge, clock_polarity_active_low);
-	SSP::initialize(frequency, spi_clock_frequency, mode);
+	uint32_t spi_frequency = SSP::initialize(frequency, spi_clock_frequency, mode);
 	System::Interrupt::enable(SSP1_IRQn);
+	return spi_frequency;
 }
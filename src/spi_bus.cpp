@@ -0,0 +1,234 @@
+// Includes
+#include "LPC17xx.h"
+#include "spi_bus.h"
+#include "spi.h"
+#include "pin.h"
+
+// Namespaces
+using namespace System;
+
+namespace System {
+
+	/************************************
+	* SPIDevice							*
+	************************************/
+
+	bool SPIDevice::Configuration::operator== (const Configuration & configuration) const {
+		return (clock_frequency == configuration.clock_frequency) &&
+				(bits == configuration.bits) &&
+				(clock_phase_2nd_edge == configuration.clock_phase_2nd_edge) &&
+				(clock_polarity_active_low == configuration.clock_polarity_active_low) &&
+				(lsb_first == configuration.lsb_first);
+	}
+
+	SPIDevice::SPIDevice (Pin & pin_cs, uint32_t clock_frequency, uint32_t bits, bool clock_phase_2nd_edge, bool clock_polarity_active_low, bool lsb_first) : _pin_cs(pin_cs) {
+		_configuration.clock_frequency = clock_frequency;
+		_configuration.bits = bits;
+		_configuration.clock_phase_2nd_edge = clock_phase_2nd_edge;
+		_configuration.clock_polarity_active_low = clock_polarity_active_low;
+		_configuration.lsb_first = lsb_first;
+
+		// Initialize the CS pin, and de-select the chip
+		_pin_cs.setDirection(Pin::Direction::output);
+		deselect();
+	}
+
+	const SPIDevice::Configuration & SPIDevice::getConfiguration (void) const {
+		return _configuration;
+	}
+
+	bool SPIDevice::configure (SPI & spi) const {
+		return spi.configure(_configuration.clock_frequency, _configuration.bits,
+				_configuration.clock_phase_2nd_edge, _configuration.clock_polarity_active_low, _configuration.lsb_first);
+	}
+
+	void SPIDevice::select (void) {
+		_pin_cs.clear();
+	}
+
+	void SPIDevice::deselect (void) {
+		_pin_cs.set();
+	}
+
+	/************************************
+	* SPIBus::Transaction				*
+	************************************/
+
+	SPIBus::Transaction::Transaction (void) {
+		device = nullptr;
+		command = nullptr;
+		command_length = 0;
+		tx_buffer = nullptr;
+		rx_buffer = nullptr;
+		length = 0;
+		handler = nullptr;
+		context = nullptr;
+		status = Status::idle;
+		next = nullptr;
+	}
+
+	SPIBus::Transaction::Transaction (SPIDevice & device, void * command, uint16_t command_length, void * tx_buffer, void * rx_buffer, uint16_t length) : Transaction() {
+		this->device = &device;
+		this->command = command;
+		this->command_length = command_length;
+		this->tx_buffer = tx_buffer;
+		this->rx_buffer = rx_buffer;
+		this->length = length;
+	}
+
+	bool SPIBus::Transaction::isDone (void) {
+		return (status == Status::completed) || (status == Status::failed);
+	}
+
+	/************************************
+	* SPIBus							*
+	************************************/
+
+	SPIBus::SPIBus (SPI & spi) : _spi(spi) {
+		_head = nullptr;
+		_tail = nullptr;
+		_command_phase = false;
+		_configured = false;
+		_reconfigurations = 0;
+
+		// The bus owns the peripheral from now on
+		_spi.attachHandler(handleCompletion, this);
+	}
+
+	bool SPIBus::submit (Transaction & transaction) {
+
+		// A transaction can only be queued once
+		if ((transaction.device == nullptr) || (transaction.status == Status::queued) || (transaction.status == Status::active)) {
+			return false;
+		}
+		transaction.status = Status::queued;
+		transaction.next = nullptr;
+
+		// Append to the queue, and start it when the bus is idle
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		if (_tail != nullptr) {
+			_tail->next = &transaction;
+		} else {
+			_head = &transaction;
+		}
+		_tail = &transaction;
+		bool idle = (_head == &transaction);
+		__set_PRIMASK(primask);
+
+		if (idle) {
+			_start();
+		}
+		return true;
+	}
+
+	bool SPIBus::isBusy (void) {
+		return (_head != nullptr);
+	}
+
+	uint32_t SPIBus::getNumberOfReconfigurations (void) {
+		return _reconfigurations;
+	}
+
+	void SPIBus::handleCompletion (void * context) {
+		SPIBus * bus = (SPIBus *) context;
+
+		// Ignore anything that was not started by the bus
+		Transaction * transaction = bus->_head;
+		if ((transaction == nullptr) || (transaction->status != Status::active)) {
+			return;
+		}
+
+		// Command sent, continue with the data while the chip stays selected
+		Status status = Status::completed;
+		if (bus->_command_phase && (transaction->length != 0)) {
+			bus->_command_phase = false;
+			if (bus->_transfer(transaction->tx_buffer, transaction->rx_buffer, transaction->length)) {
+				return;
+			}
+			status = Status::failed;
+		}
+
+		// Done, go on with the next transaction right away
+		transaction->device->deselect();
+		bus->_finish(status);
+		bus->_start();
+	}
+
+	void SPIBus::_start (void) {
+
+		// Start the first queued transaction, the ones that cannot be started are failed
+		while (_head != nullptr) {
+			Transaction & transaction = *_head;
+			if (transaction.status != Status::queued) {
+				return;
+			}
+
+			// Only reprogram the peripheral when the settings differ from the previous device
+			const SPIDevice::Configuration & configuration = transaction.device->getConfiguration();
+			if (!_configured || !(configuration == _configuration)) {
+				if (!transaction.device->configure(_spi)) {
+					_configured = false;
+					_finish(Status::failed);
+					continue;
+				}
+				_configuration = configuration;
+				_configured = true;
+				_reconfigurations++;
+			}
+
+			// Nothing to send at all
+			if ((transaction.command_length == 0) && (transaction.length == 0)) {
+				_finish(Status::completed);
+				continue;
+			}
+
+			// Start with the command (if any), the ISR continues with the data
+			transaction.status = Status::active;
+			transaction.device->select();
+			bool started;
+			if (transaction.command_length != 0) {
+				_command_phase = true;
+				started = _transfer(transaction.command, nullptr, transaction.command_length);
+			} else {
+				_command_phase = false;
+				started = _transfer(transaction.tx_buffer, transaction.rx_buffer, transaction.length);
+			}
+			if (started) {
+				return;
+			}
+			transaction.device->deselect();
+			_finish(Status::failed);
+		}
+	}
+
+	bool SPIBus::_transfer (void * tx_buffer, void * rx_buffer, uint16_t length) {
+
+		// Always interrupt driven: a polled transfer would complete (and chain the next one) before returning
+		if (_configuration.bits > 8) {
+			return _spi.transceive((uint16_t *) tx_buffer, (uint16_t *) rx_buffer, length, SPI::TransferMode::interrupt_driven);
+		} else {
+			return _spi.transceive((uint8_t *) tx_buffer, (uint8_t *) rx_buffer, length, SPI::TransferMode::interrupt_driven);
+		}
+	}
+
+	void SPIBus::_finish (Status status) {
+
+		// Remove the first transaction from the queue
+		Transaction & transaction = *_head;
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		_head = transaction.next;
+		if (_head == nullptr) {
+			_tail = nullptr;
+		}
+		__set_PRIMASK(primask);
+
+		// Report the result, the handler may submit the transaction again
+		transaction.next = nullptr;
+		transaction.status = status;
+		if (transaction.handler != nullptr) {
+			transaction.handler(transaction.context);
+		}
+	}
+}
@@ -17,6 +17,9 @@ using namespace System;
 
 namespace {
 	void (*handleInterruptPointer[4]) (void) = {nullptr, nullptr, nullptr, nullptr};
+
+	// Depth of the hardware TX FIFO
+	const uint32_t _tx_fifo_size = 16;
 }
 
 extern "C" {
@@ -66,9 +69,12 @@ namespace System {
 		_tx_dma_handle = nullptr;
 		_rx_dma_handle = nullptr;
 		_tx_busy = false;
+		_tx_interrupt_count = 0;
+		_tx_byte_count = 0;
+		_tx_ring_in_flight = 0;
 	}
 
-	void UART::initialize (uint32_t pin_txd_index, GPIO::Function function, uint32_t peripheral_frequency, uint32_t baudrate, uint8_t mode) {
+	void UART::initialize (uint32_t pin_txd_index, GPIO::Function function, uint32_t peripheral_frequency, uint32_t baudrate, uint8_t mode, ReceiveTriggerLevel trigger_level) {
 
 		// Init TXD pin
 		GPIOPin pin_txd(pin_txd_index);
@@ -85,9 +91,9 @@ namespace System {
 		// Set the desired baudrate
 		setBaudrate(peripheral_frequency, baudrate);
 
-		// Enable the UART interface
+		// Enable the UART interface (the RX trigger level determines how many characters are handled per interrupt)
 		_lpc_uart->LCR = mode;
-		_lpc_uart->FCR = (1 << 3) | (1 << 2) | (1 << 1) | (1 << 0);
+		_lpc_uart->FCR = (((uint8_t) trigger_level) << 6) | (1 << 3) | (1 << 2) | (1 << 1) | (1 << 0);
 		_lpc_uart->IER = 0;
 	}
 
@@ -185,18 +191,21 @@ namespace System {
 				volatile uint32_t error = _lpc_uart->LSR;
 			}
 
-			// Receive data available or character time-out
+			// Receive data available or character time-out, empty the complete RX FIFO
 			if (((interrupt_status & (7 << 1)) == (2 << 1)) || ((interrupt_status & (7 << 1)) == (6 << 1))) {
-				_rx_buffer[_rx_write_index] = _lpc_uart->RBR;
-				_rx_write_index = (_rx_write_index + 1) % _rx_buffer_size;
+				while (_lpc_uart->LSR & (1 << 0)) {
+					uint8_t data = _lpc_uart->RBR;
+					_rx_ring.push(data);
+				}
 			}
 
-			// Transmit buffer empty
+			// Transmit buffer empty, refill the complete TX FIFO
 			if ((interrupt_status & (7 << 1)) == (1 << 1)) {
+				_tx_interrupt_count++;
 				if (_tx_length > 0) {
-					_lpc_uart->THR = *_tx_buffer;
-					_tx_buffer++;
-					_tx_length--;
+					_fillTransmitFIFO();
+				} else if (_tx_ring.size() != 0) {
+					_tx_busy = _transmitFromQueue();
 				} else {
 					_tx_busy = false;
 				}
@@ -208,77 +217,101 @@ namespace System {
 	}
 
 	void UART::receive (uint8_t * rx_buffer, uint16_t rx_buffer_size) {
-		_rx_buffer = rx_buffer;
-		_rx_buffer_size = rx_buffer_size;
-		_rx_read_index = 0;
-		_rx_write_index = 0;
+		_rx_ring.assign(rx_buffer, rx_buffer_size);
 
 		// Enable interrupts, no DMA
 		_lpc_uart->IER |= (1 << 0);
 		_rx_dma_handle = nullptr;
 	}
 
-	void UART::receive (uint8_t * rx_buffer, uint16_t rx_buffer_size, DMA & dma) {
+	bool UART::receive (uint8_t * rx_buffer, uint16_t rx_buffer_size, DMA & dma) {
 		_rx_dma_handle = &dma;
-		_rx_buffer = rx_buffer;
-		_rx_buffer_size = rx_buffer_size;
-		_rx_read_index = 0;
+		_rx_ring.assign(rx_buffer, rx_buffer_size);
 
 		// Disable interrupts
 		_lpc_uart->IER &= ~(1 << 0);
 
-		// Set up the DMA
+		// Set up the DMA, or receive with interrupts if the buffer needs more segments than the DMA has
 		configureReceiveDMA(_rx_dma_handle);
-		_rx_dma_handle->transfer(&(_lpc_uart->RBR), _rx_buffer, _rx_buffer_size, true);
+		if (!_rx_dma_handle->transfer(&(_lpc_uart->RBR), _rx_ring.data(), _rx_ring.size(), true)) {
+			_rx_dma_handle = nullptr;
+			_lpc_uart->IER |= (1 << 0);
+			return false;
+		}
+		return true;
 	}
 
 	uint16_t UART::bytesAvailable (void) {
 
-		// Using DMA?
+		// Using DMA? Then the write position follows from the DMA progress
 		if (_rx_dma_handle != nullptr) {
-			_rx_write_index = 0 - _rx_dma_handle->getNumberOfTransfersLeft();
+			_rx_ring.commitTo(0 - _rx_dma_handle->getNumberOfTransfersLeft());
 		}
-		return (_rx_buffer_size + _rx_write_index - _rx_read_index) % _rx_buffer_size;
+		return _rx_ring.available();
 	}
 
 	uint8_t UART::getChar (void) {
-		if (bytesAvailable() == 0) {
-			return 0;
+		uint8_t data = 0;
+		if (bytesAvailable() != 0) {
+			_rx_ring.pop(data);
 		}
-
-		uint8_t data = _rx_buffer[_rx_read_index];
-		_rx_read_index = (_rx_read_index + 1) % _rx_buffer_size;
 		return data;
 	}
 
+	uint16_t UART::peek (Span & first, Span & second) {
+
+		// Update the DMA write position (if used) once, then access the buffer in place
+		bytesAvailable();
+		return _rx_ring.peek(first, second);
+	}
+
+	void UART::consume (uint16_t length) {
+		_rx_ring.consume(length);
+	}
+
 	bool UART::transmit (uint8_t * tx_buffer, uint16_t tx_length) {
 
+		// Queued? Then only reject the data if it does not fit
+		if (_tx_ring.size() != 0) {
+			if (_tx_ring.free() < tx_length)
+				return false;
+			write(tx_buffer, tx_length);
+			return true;
+		}
+
 		// Check if a new transfer can be started
 		if (isTransmitting())
 			return false;
 		if (tx_length == 0)
 			return true;
 
-		// Enable interrupts, no DMA
-		_lpc_uart->IER |= (1 << 1);
+		// No DMA, keep the ISR out while the transfer is set up
+		_lpc_uart->IER &= ~(1 << 1);
 		_tx_dma_handle = nullptr;
 
-		// Set the first character, the rest is handled in the ISR
-		_lpc_uart->THR = *tx_buffer;
-		tx_buffer++;
-		tx_length--;
-
 		// Store all settings
+		_tx_busy = true;
 		_tx_buffer = tx_buffer;
 		_tx_length = tx_length;
 
+		// Fill the TX FIFO, the rest is handled in the ISR
+		_fillTransmitFIFO();
+		_lpc_uart->IER |= (1 << 1);
+
 		// The transfer was successfully started
-		_tx_busy = true;
 		return true;
 	}
 
 	bool UART::transmit (uint8_t * tx_buffer, uint16_t tx_length, DMA & dma) {
 
+		// Queued? Then only reject the data if it does not fit
+		if (_tx_ring.size() != 0) {
+			if (_tx_ring.free() < tx_length)
+				return false;
+			write(tx_buffer, tx_length);
+			return true;
+		}
+
 		// Check if a new transfer can be started
 		if (isTransmitting())
 			return false;
@@ -289,22 +322,128 @@ namespace System {
 		_lpc_uart->IER &= ~(1 << 1);
 		_tx_dma_handle = &dma;
 
-		// Start DMA transfer
+		// Start DMA transfer, or leave the UART idle (without DMA) if the length needs more segments than the DMA has
 		configureTransmitDMA(_tx_dma_handle);
-		_tx_dma_handle->transfer(tx_buffer, &(_lpc_uart->THR), tx_length, false);
+		if (!_tx_dma_handle->transfer(tx_buffer, &(_lpc_uart->THR), tx_length, false)) {
+			_tx_dma_handle = nullptr;
+			_lpc_uart->IER |= (1 << 1);
+			return false;
+		}
 
 		// The transfer was successfully started
 		return true;
 	}
 
-	bool UART::isTransmitting (void) {
+	void UART::_fillTransmitFIFO (void) {
+
+		// Only called when the TX FIFO is empty, so all entries are available
+		uint32_t count = _tx_length;
+		if (count > _tx_fifo_size) {
+			count = _tx_fifo_size;
+		}
+		_tx_length -= count;
+		_tx_byte_count += count;
+
+		uint8_t * tx_buffer = _tx_buffer;
+		while (count--) {
+			_lpc_uart->THR = *tx_buffer++;
+		}
+		_tx_buffer = tx_buffer;
+	}
+
+	bool UART::_transmitFromQueue (void) {
+
+		// Using DMA? Release the part of the queue that was handed to the DMA once it is done
+		if (_tx_dma_handle != nullptr) {
+			if (_tx_dma_handle->getNumberOfTransfersLeft() != 0) {
+				return true;
+			}
+			_tx_ring.consume(_tx_ring_in_flight);
+			_tx_ring_in_flight = 0;
+		}
+
+		// Anything left to transmit?
+		Span first, second;
+		if (_tx_ring.peek(first, second) == 0) {
+			return false;
+		}
 
-		// Using DMA?
+		// Using DMA? Transmit the first contiguous part, the THRE interrupt signals its completion
+		// If the DMA cannot take it, the queue continues without DMA (the THRE interrupt is already enabled)
 		if (_tx_dma_handle != nullptr) {
+			_tx_ring_in_flight = first.length;
+			if (_tx_dma_handle->transfer(first.data, &(_lpc_uart->THR), first.length, false)) {
+				return true;
+			}
+			_tx_ring_in_flight = 0;
+			_tx_dma_handle = nullptr;
+		}
+
+		// Only called when the TX FIFO is empty, so all entries are available
+		uint32_t count = 0;
+		while ((count < _tx_fifo_size) && (count < first.length)) {
+			_lpc_uart->THR = first.data[count++];
+		}
+		for (uint32_t i = 0; (count < _tx_fifo_size) && (i < second.length); i++) {
+			_lpc_uart->THR = second.data[i];
+			count++;
+		}
+		_tx_ring.consume(count);
+		_tx_byte_count += count;
+		return true;
+	}
+
+	void UART::transmitQueue (uint8_t * tx_queue_buffer, uint16_t tx_queue_size) {
+		_tx_ring.assign(tx_queue_buffer, tx_queue_size);
+		_tx_ring_in_flight = 0;
+
+		// Enable interrupts, no DMA
+		_tx_dma_handle = nullptr;
+		_lpc_uart->IER |= (1 << 1);
+	}
+
+	void UART::transmitQueue (uint8_t * tx_queue_buffer, uint16_t tx_queue_size, DMA & dma) {
+		_tx_ring.assign(tx_queue_buffer, tx_queue_size);
+		_tx_ring_in_flight = 0;
+
+		// Set up the DMA, the THRE interrupt is used to continue with the next part of the queue
+		_tx_dma_handle = &dma;
+		configureTransmitDMA(_tx_dma_handle);
+		_lpc_uart->IER |= (1 << 1);
+	}
+
+	uint16_t UART::write (const uint8_t * data, uint16_t length) {
+		uint16_t count = _tx_ring.push(data, length);
+
+		// Start transmitting if idle, otherwise the ISR continues with the new data
+		if (!_tx_busy) {
+			_lpc_uart->IER &= ~(1 << 1);
+			_tx_busy = _transmitFromQueue();
+			_lpc_uart->IER |= (1 << 1);
+		}
+		return count;
+	}
+
+	uint16_t UART::bytesFree (void) {
+		return _tx_ring.free();
+	}
+
+	bool UART::isTransmitting (void) {
+
+		// Using DMA without a queue?
+		if ((_tx_dma_handle != nullptr) && (_tx_ring.size() == 0)) {
 			_tx_busy = (_tx_dma_handle->getNumberOfTransfersLeft() != 0);
 		}
 		return (_tx_busy || ((_lpc_uart->LSR & (1 << 5)) == 0));
 	}
+
+	uint32_t UART::getTransmitInterruptCount (void) {
+		return _tx_interrupt_count;
+	}
+
+	uint32_t UART::getTransmitByteCount (void) {
+		return _tx_byte_count;
+	}
 }
 
 /************************************
@@ -342,14 +481,14 @@ void UART0::configureTransmitDMA (DMA * dma) {
 			true, false);
 }
 
-void UART0::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control) {
+void UART0::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control, UART::ReceiveTriggerLevel trigger_level) {
 	Clock::enablePeripheral(Clock::PeripheralPower::uart_0_power);
 	Clock::setPeripheralClock(Clock::PeripheralClock::uart_0_clock, clock);
 	uint32_t frequency = Clock::getPeripheralClockFrequency(Clock::PeripheralClock::uart_0_clock);
 
 	uint32_t pin_txd = PIN(0, 2);
 	uint8_t mode = UART::mode(character_length, stop_bits, parity, enable_break_control);
-	UART::initialize(pin_txd, GPIO::Function::alternate_1, frequency, baudrate, mode);
+	UART::initialize(pin_txd, GPIO::Function::alternate_1, frequency, baudrate, mode, trigger_level);
 	System::Interrupt::enable(UART0_IRQn);
 }
 
@@ -388,7 +527,7 @@ void UART1::configureTransmitDMA (DMA * dma) {
 			true, false);
 }
 
-void UART1::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control, PinSelection pin_selection) {
+void UART1::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control, PinSelection pin_selection, UART::ReceiveTriggerLevel trigger_level) {
 	Clock::enablePeripheral(Clock::PeripheralPower::uart_1_power);
 	Clock::setPeripheralClock(Clock::PeripheralClock::uart_1_clock, clock);
 	uint32_t frequency = Clock::getPeripheralClockFrequency(Clock::PeripheralClock::uart_1_clock);
@@ -401,7 +540,7 @@ void UART1::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UA
 	}
 
 	uint8_t mode = UART::mode(character_length, stop_bits, parity, enable_break_control);
-	UART::initialize(pin_txd, pin_function, frequency, baudrate, mode);
+	UART::initialize(pin_txd, pin_function, frequency, baudrate, mode, trigger_level);
 	System::Interrupt::enable(UART1_IRQn);
 }
 
@@ -440,7 +579,7 @@ void UART2::configureTransmitDMA (DMA * dma) {
 			true, false);
 }
 
-void UART2::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control, PinSelection pin_selection) {
+void UART2::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control, PinSelection pin_selection, UART::ReceiveTriggerLevel trigger_level) {
 	Clock::enablePeripheral(Clock::PeripheralPower::uart_2_power);
 	Clock::setPeripheralClock(Clock::PeripheralClock::uart_2_clock, clock);
 	uint32_t frequency = Clock::getPeripheralClockFrequency(Clock::PeripheralClock::uart_2_clock);
@@ -453,7 +592,7 @@ void UART2::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UA
 	}
 
 	uint8_t mode = UART::mode(character_length, stop_bits, parity, enable_break_control);
-	UART::initialize(pin_txd, pin_function, frequency, baudrate, mode);
+	UART::initialize(pin_txd, pin_function, frequency, baudrate, mode, trigger_level);
 	System::Interrupt::enable(UART2_IRQn);
 }
 
@@ -492,7 +631,7 @@ void UART3::configureTransmitDMA (DMA * dma) {
 			true, false);
 }
 
-void UART3::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control, PinSelection pin_selection) {
+void UART3::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UART::CharacterLength character_length, UART::StopBits stop_bits, UART::Parity parity, bool enable_break_control, PinSelection pin_selection, UART::ReceiveTriggerLevel trigger_level) {
 	Clock::enablePeripheral(Clock::PeripheralPower::uart_3_power);
 	Clock::setPeripheralClock(Clock::PeripheralClock::uart_3_clock, clock);
 	uint32_t frequency = Clock::getPeripheralClockFrequency(Clock::PeripheralClock::uart_3_clock);
@@ -508,6 +647,6 @@ void UART3::initialize (Clock::PeripheralClockSpeed clock, uint32_t baudrate, UA
 	}
 
 	uint8_t mode = UART::mode(character_length, stop_bits, parity, enable_break_control);
-	UART::initialize(pin_txd, pin_function, frequency, baudrate, mode);
+	UART::initialize(pin_txd, pin_function, frequency, baudrate, mode, trigger_level);
 	System::Interrupt::enable(UART3_IRQn);
 }
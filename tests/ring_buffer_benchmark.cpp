@@ -0,0 +1,89 @@
+// Host push/pop throughput of System::RingBuffer, single and bulk, on one thread and between two threads
+// g++ -std=c++17 -O2 -pthread -iquote inc tests/ring_buffer_benchmark.cpp -o ring_buffer_benchmark && ./ring_buffer_benchmark
+
+// Includes
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "ring_buffer.h"
+
+// Namespaces
+using namespace System;
+
+namespace {
+	const uint32_t _items = 50000000;
+	RingBuffer<uint8_t, 256> _buffer;
+
+	double seconds (std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void report (const char * name, double time) {
+		printf("%-28s %8.1f Mitems/s\n", name, _items / time / 1e6);
+	}
+}
+
+int main (void) {
+	uint8_t item = 0;
+	uint8_t block[64] = {0};
+
+	// Single items, producer and consumer alternating on one thread
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < _items; i++) {
+		_buffer.push((uint8_t) i);
+		_buffer.pop(item);
+	}
+	report("push/pop, one thread", seconds(start));
+
+	// Blocks of 64 items
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < _items; i += sizeof(block)) {
+		_buffer.push(block, sizeof(block));
+		_buffer.pop(block, sizeof(block));
+	}
+	report("bulk 64, one thread", seconds(start));
+
+	// Single items between two threads (like an ISR and the main loop)
+	start = std::chrono::steady_clock::now();
+	std::thread producer([] () {
+		for (uint32_t i = 0; i < _items;) {
+			if (_buffer.push((uint8_t) i)) {
+				i++;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	});
+	for (uint32_t i = 0; i < _items;) {
+		if (_buffer.pop(item)) {
+			i++;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	report("push/pop, two threads", seconds(start));
+
+	// Blocks between two threads
+	start = std::chrono::steady_clock::now();
+	producer = std::thread([] () {
+		uint8_t block[64] = {0};
+		for (uint32_t i = 0; i < _items;) {
+			uint32_t count = _buffer.push(block, sizeof(block));
+			if (count == 0) {
+				std::this_thread::yield();
+			}
+			i += count;
+		}
+	});
+	for (uint32_t i = 0; i < _items;) {
+		uint32_t count = _buffer.pop(block, sizeof(block));
+		if (count == 0) {
+			std::this_thread::yield();
+		}
+		i += count;
+	}
+	producer.join();
+	report("bulk 64, two threads", seconds(start));
+	return (int) item & 0;
+}
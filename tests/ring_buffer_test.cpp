@@ -0,0 +1,143 @@
+// Host unit tests for System::RingBuffer
+// g++ -std=c++17 -O2 -pthread -iquote inc tests/ring_buffer_test.cpp -o ring_buffer_test && ./ring_buffer_test
+
+// Includes
+#include <cstdio>
+#include <thread>
+#include "ring_buffer.h"
+
+// Namespaces
+using namespace System;
+
+namespace {
+	uint32_t failures = 0;
+
+	void check (bool condition, const char * description) {
+		if (!condition) {
+			printf("FAIL: %s\n", description);
+			failures++;
+		}
+	}
+}
+
+/***************************************************
+* Single threaded
+***************************************************/
+
+void test_push_pop (void) {
+	RingBuffer<uint8_t, 8> buffer;
+	check(buffer.isEmpty() && (buffer.size() == 8) && (buffer.free() == 8), "empty after construction");
+	for (uint8_t i = 0; i < 8; i++) {
+		check(buffer.push(i), "push until full");
+	}
+	check(buffer.isFull() && !buffer.push(8), "push into a full buffer is rejected");
+	uint8_t item;
+	for (uint8_t i = 0; i < 8; i++) {
+		check(buffer.pop(item) && (item == i), "pop in order");
+	}
+	check(buffer.isEmpty() && !buffer.pop(item), "pop from an empty buffer is rejected");
+}
+
+void test_bulk_wrap (void) {
+	RingBuffer<uint16_t, 16> buffer;
+	uint16_t in[32];
+	uint16_t out[32];
+	for (uint16_t i = 0; i < 32; i++) {
+		in[i] = i;
+	}
+
+	// Move the indices so the copies wrap around the end of the storage
+	check(buffer.push(in, 11) == 11, "bulk push");
+	check(buffer.pop(out, 11) == 11, "bulk pop");
+	check(buffer.push(in, 32) == 16, "bulk push is limited to the free space");
+	check(buffer.pop(out, 32) == 16, "bulk pop is limited to the available items");
+	bool same = true;
+	for (uint16_t i = 0; i < 16; i++) {
+		same = same && (out[i] == i);
+	}
+	check(same, "bulk data survives the wrap around");
+}
+
+void test_peek_consume (void) {
+	RingBuffer<uint8_t, 8> buffer;
+	uint8_t in[] = {1, 2, 3, 4, 5, 6};
+	buffer.push(in, 6);
+	buffer.consume(5);
+	buffer.push(in, 6);
+	RingBufferBase<uint8_t>::Span first, second;
+	check(buffer.peek(first, second) == 7, "peek reports all items");
+	check((first.length == 3) && (second.length == 4), "peek splits at the end of the storage");
+	check((first.data[0] == 6) && (second.data[0] == 3), "peek points into the storage");
+	buffer.consume(7);
+	check(buffer.isEmpty(), "consume releases the items");
+}
+
+void test_commit_to (void) {
+	RingBuffer<uint8_t, 8> buffer;
+	buffer.data()[0] = 10;
+	buffer.data()[1] = 11;
+	buffer.data()[2] = 12;
+	buffer.commitTo(3);
+	uint8_t item;
+	check((buffer.available() == 3) && buffer.pop(item) && (item == 10), "commitTo publishes up to a position");
+}
+
+void test_assign (void) {
+	uint32_t storage[12];
+	RingBufferBase<uint32_t> buffer(storage, 12);
+	check(buffer.size() == 8, "only the largest power of two is used");
+
+	RingBufferBase<uint32_t> unconfigured;
+	uint32_t item = 1;
+	check((unconfigured.size() == 0) && !unconfigured.push(item), "push without storage is rejected");
+	check(unconfigured.push(&item, 1) == 0, "bulk push without storage is rejected");
+	unconfigured.commit(1);
+	check(!unconfigured.pop(item), "commit without storage is ignored");
+	unconfigured.assign(storage, 0);
+	check(!unconfigured.push(item), "push into a storage of size 0 is rejected");
+}
+
+/***************************************************
+* Producer and consumer on their own threads
+***************************************************/
+
+void test_spsc (void) {
+	static RingBuffer<uint32_t, 64> buffer;
+	const uint32_t count = 1000000;
+	std::thread producer([] () {
+		for (uint32_t i = 0; i < count;) {
+			if (buffer.push(i)) {
+				i++;
+			} else {
+				std::this_thread::yield();
+			}
+		}
+	});
+	bool ordered = true;
+	for (uint32_t i = 0; i < count;) {
+		uint32_t item;
+		if (buffer.pop(item)) {
+			ordered = ordered && (item == i);
+			i++;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	check(ordered && buffer.isEmpty(), "all items arrive in order across threads");
+}
+
+int main (void) {
+	test_push_pop();
+	test_bulk_wrap();
+	test_peek_consume();
+	test_commit_to();
+	test_assign();
+	test_spsc();
+	if (failures != 0) {
+		printf("%u test(s) failed\n", failures);
+		return 1;
+	}
+	printf("All tests passed\n");
+	return 0;
+}
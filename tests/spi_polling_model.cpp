@@ -0,0 +1,183 @@
+// Host model of the CPU time spent on a short SSP transfer, polled against interrupt driven, to find the crossover length
+// behind SPI_POLLING_THRESHOLD. The SSP (8 frame FIFOs, RX half full and RX time-out interrupts) and the code paths of
+// SPI::_transceive(), SPI::_poll() and SSP::handle() are stepped cycle by cycle, with the costs below.
+// g++ -std=c++17 -O2 tests/spi_polling_model.cpp -o spi_polling_model && ./spi_polling_model
+
+// Includes
+#include <cstdint>
+#include <cstdio>
+
+namespace {
+
+	// Cortex-M3 costs in CPU cycles (code from flash through the accelerator, a few wait states per APB access)
+	const uint32_t _setup = 40;				// Checks and settings in _transceive(), the same for both modes
+	const uint32_t _write = 10;				// _write<>() of a single frame, with the _tx_length decrement
+	const uint32_t _next = 30;				// next() through the member pointer: read, store, count, write the next frame
+	const uint32_t _complete = 10;			// complete(), without the handler itself
+	const uint32_t _primask = 4;			// Saving, disabling and restoring PRIMASK around the FIFO fill
+	const uint32_t _nvic = 6;				// Interrupt::disable(), enable() or clearPending()
+	const uint32_t _poll = 6;				// One status register poll in SPI::_poll()
+	const uint32_t _entry = 12;				// Exception entry (stacking and vector fetch)
+	const uint32_t _exit = 10;				// Exception return (unstacking)
+	const uint32_t _dispatch = 14;			// SSPx_IRQHandler through handleInterruptPointer to SSP::handle()
+	const uint32_t _status = 6;				// MIS read and test in SSP::handle()
+	const uint32_t _check = 8;				// isBusy() and the SR test of every loop in SSP::handle()
+	const uint32_t _clear = 4;				// ICR write
+
+	// SSP with 8 frame FIFOs, shifting frames back to back while the TX FIFO is not empty
+	const uint32_t _fifo_depth = 8;
+	const uint32_t _half_full = 4;
+	const uint32_t _timeout_bits = 32;
+
+	struct SSP {
+		uint32_t frame;						// Cycles per frame
+		uint32_t tx = 0;					// Frames waiting in the TX FIFO (not the one being shifted)
+		uint32_t rx = 0;					// Frames waiting in the RX FIFO
+		bool shifting = false;
+		uint64_t done = 0;					// End of the frame being shifted
+		uint64_t activity = 0;				// Last frame received or read, for the time-out
+
+		void run (uint64_t time) {
+			while (shifting && (done <= time)) {
+				rx++;
+				activity = done;
+				if (tx != 0) {
+					tx--;
+					done += frame;
+				} else {
+					shifting = false;
+				}
+			}
+		}
+
+		void write (uint64_t time) {
+			if (!shifting) {
+				shifting = true;
+				done = time + frame;
+			} else {
+				tx++;
+			}
+		}
+
+		void read (uint64_t time) {
+			rx--;
+			activity = time;
+		}
+	};
+
+	struct Result {
+		uint64_t cpu;						// Cycles the CPU spends on the transfer
+		uint64_t latency;					// Cycles until the completion handler runs
+	};
+
+	Result polled (uint32_t length, uint32_t frame) {
+		SSP ssp = {frame};
+		uint64_t time = _setup + _nvic;
+		uint32_t tx_length = length;
+		for (; (tx_length != 0) && (length - tx_length < _fifo_depth); tx_length--) {
+			time += _write;
+			ssp.write(time);
+		}
+		for (; length != 0; length--) {
+			for (ssp.run(time); ssp.rx == 0; ssp.run(time)) {
+				time += _poll;
+			}
+			time += (length == 1) ? _nvic + _next + _complete : _next;
+			ssp.read(time);
+			if (tx_length != 0) {
+				ssp.write(time);
+				tx_length--;
+			}
+		}
+		time += _nvic;
+		return {time, time};
+	}
+
+	Result interruptDriven (uint32_t length, uint32_t frame, uint32_t bit) {
+		SSP ssp = {frame};
+		uint64_t time = _setup + _primask;
+		uint32_t tx_length = length;
+		for (; (tx_length != 0) && (length - tx_length < _fifo_depth); tx_length--) {
+			time += _write;
+			ssp.write(time);
+		}
+		uint64_t cpu = time;
+		uint64_t latency = 0;
+		while (length != 0) {
+
+			// Wait for the RX half full or the RX time-out interrupt
+			for (ssp.run(time); (ssp.rx < _half_full) && ((ssp.rx == 0) || (time - ssp.activity < _timeout_bits * bit)); ssp.run(time)) {
+				time++;
+			}
+
+			// SSP::handle()
+			uint64_t start = time;
+			time += _entry + _dispatch + _status;
+			for (;;) {
+				time += _check;
+				ssp.run(time);
+				if ((length == 0) || (ssp.rx == 0)) {
+					break;
+				}
+				time += _next;
+				ssp.read(time);
+				length--;
+				if (length == 0) {
+					time += _complete;
+					latency = time;
+				} else if (tx_length != 0) {
+					ssp.write(time);
+					tx_length--;
+				}
+			}
+			time += _clear + _exit;
+			cpu += time - start;
+		}
+		return {cpu, latency};
+	}
+}
+
+int main (void) {
+	const uint32_t dividers[] = {2, 4, 8, 16, 32, 64};
+	const uint32_t bits[] = {8, 16};
+	const uint32_t maximum_length = 64;
+
+	// Polling keeps the CPU busy for the whole transfer, but completes it without the interrupt entries and without
+	// waiting for the RX time-out of the last frames. It pays off while the extra CPU cycles are no more than the cycles
+	// it gets the completion earlier (the callers that wait for it spin on isBusy() in the meantime).
+	printf("Crossover (longest length up to which polling pays off)\n");
+	printf("%-28s %10s %10s\n", "SSP clock", "8-bit", "16-bit");
+	for (uint32_t divider : dividers) {
+		char name[32];
+		snprintf(name, sizeof(name), "CCLK / %u", divider);
+		printf("%-28s", name);
+		for (uint32_t frame_bits : bits) {
+			uint32_t crossover = 0;
+			for (uint32_t length = 1; length <= maximum_length; length++) {
+				Result poll = polled(length, frame_bits * divider);
+				Result irq = interruptDriven(length, frame_bits * divider, divider);
+				if ((int64_t) (poll.cpu - irq.cpu) > (int64_t) (irq.latency - poll.latency)) {
+					break;
+				}
+				crossover = length;
+			}
+			if (crossover == maximum_length) {
+				printf(" %9u+", maximum_length);
+			} else {
+				printf(" %10u", crossover);
+			}
+		}
+		printf("\n");
+	}
+
+	// Details at the default configuration: PCLK = CCLK / 4 with the fastest SSP clock (PCLK / 2), 8-bit frames
+	printf("\nCCLK / 8, 8-bit frames (CPU cycles)\n");
+	printf("%-8s %10s %10s %10s %10s %10s\n", "length", "polled", "irq cpu", "irq done", "extra cpu", "earlier");
+	for (uint32_t length = 1; length <= 16; length++) {
+		Result poll = polled(length, 8 * 8);
+		Result irq = interruptDriven(length, 8 * 8, 8);
+		printf("%-8u %10llu %10llu %10llu %10lld %10lld\n", length, (unsigned long long) poll.cpu, (unsigned long long) irq.cpu,
+				(unsigned long long) irq.latency, (long long) (poll.cpu - irq.cpu), (long long) (irq.latency - poll.latency));
+	}
+	return 0;
+}